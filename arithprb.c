@@ -6,7 +6,11 @@
 *
 *	By Terry R. McConnell
 *
-*  Compile: cc -o arithprb arithprb.c
+*  Compile: cc -o arithprb arithprb.c -lpthread
+*
+*  With -b (or -batch) nn, writes nn worksheets, with versions (seeds) s, s+1, ...,
+*  to files arithprbV.txt (or .tex, .html, .json) in the directory given by -o,
+*  on several threads, and reports how many worksheets per second were made.
 *
 */
 
@@ -14,30 +18,47 @@
 #include<stdlib.h>
 #include<string.h>
 #include<time.h>
-
-#ifndef BUFFER_SIZE
-#define BUFFER_SIZE 16184
+#include<stdint.h>
+#include<errno.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/stat.h>
+
+/* Size of the output buffer. Rows of problems are written as they are
+   finished, so large problem sets need no more memory than small ones. */
+#ifndef OUTBUF
+#define OUTBUF (1<<20)
 #endif
 
 /* This needs to be changed in strings below too */
 #define NPROBS 12
 
-#define VERSION "1.1"
+#define MAX_THREADS 64
+
+#define VERSION "1.5"
 #define PROGNAME "arithprb"
-#define USAGE "arithprb [-n <nn> -s <nn> -c <nn> -t -vh]"
+#define USAGE "arithprb [-n <nn> -s <nn> -c <nn> -b <nn> -o <dir> -j <nn> -f <fmt> -t -vh]"
 
 #define HELP "-h: print this helpful message\n\
 -v: print version number and exit\n\
 -n: generate nn problems  (default is 12) \n\
 -s: use nn as RNG seed (default is current system time if available.)\n\
 -c: print problems in nn columns (default is 3.)\n\
--t: write output as a TeX source file (latex)\n\n\
+-t: write output as a TeX source file (latex), same as -f tex\n\
+-f: write output in format fmt: ascii (default), tex, html or json\n\
+-b: write nn worksheets, versions s, s+1, ..., to files (see -o)\n\
+-o: directory for -b (default is the current directory.)\n\
+-j: use nn threads for -b (default is the number of processors.)\n\n\
 Prints page of arithmetic problems to stdout, followed by page of answers. \n\n"
 
 /* In its default setup, this program writes to stdout a description of
 a page of arithmetic problems. It can write either an ascii text "prettyprint"
 version of the arithmetic problems, or a LaTeX source file, which must 
-subsequently be typeset to see the problems. 
+subsequently be typeset to see the problems. With -f it can also write an
+HTML page, or JSON for other programs to read. Each format is a backend
+(struct backend below); the placement of the problems on the page is worked
+out once and handed to whichever backend is in use, so a new format only
+has to say how to write a problem, not where it goes.
 
 In either version, the program views the page as a table of 3 columns and
 4 rows (in the default setup). Each table entry is a conceptual box containing
@@ -52,22 +73,56 @@ but it is not so easy to change the default TeX setup.
 
 */
 
-/* output types */
-
-#define ASCII 0
-#define TEX 1
-
-/* Call these depending on type of output */
-
-static int make_prob_ascii(int row, int col, int type, int ans); 
-static int make_prob_tex(int row, int col, int type, int ans); 
-static int(*make_prob)(int,int,int,int);
+/* A problem: its type (below), its operands, the larger first, and its
+   answer. The problems are generated once, into an array of these, and
+   both the problem pages and the answer pages are printed from it. */
+
+struct prob {
+	int arg1, arg2, answer;
+	unsigned char type;
+};
+
+/* Where a problem goes on the page: its row and column (from 1), the
+   offset of its box within a line of ASCII output, and whether it starts
+   or ends a row of the page. It depends only on the problem's number, the
+   number of problems and the columns, so layout() works it out as each
+   problem is printed, and nothing is kept per problem. */
+
+struct place {
+	int i, row, col, off;
+	unsigned char first, last;
+};
+
+/* A worksheet being written: where it goes, the row buffer for ASCII
+   output, the random number generator, and its problems. */
+
+struct sheet;
+
+/* An output format. The layout engine (print_probs) calls these in
+   order: begin once, then for each of the problem page (ans ==
+   NO_ANSWERS) and the answer page (ans == ANSWERS): page, then row,
+   prob for each problem in the row, and row_end for each row, then
+   page_end; then end. Any but prob may be NULL. ext is the file name
+   extension used by -b. */
+
+struct backend {
+	char *name, *ext;
+	void (*begin)(struct sheet *sh, int seed, char *date);
+	void (*page)(struct sheet *sh, int seed, char *date, int ans);
+	void (*row)(struct sheet *sh, struct place *pl);
+	void (*prob)(struct sheet *sh, struct place *pl, struct prob *p, int ans);
+	void (*row_end)(struct sheet *sh, struct place *pl);
+	void (*page_end)(struct sheet *sh, int ans);
+	void (*end)(struct sheet *sh);
+};
+
+static struct backend *backend;
 
 /* Stuff for the ascii problem generator */
 
 #define BANNER "\n\nDo the following arithmetic problems:\n\
 (Answers on next page.)\n\n\n\n\n\n\n"
-static char page_buf[BUFFER_SIZE];
+static int row_len;	/* length of a row of problems */
 static int cspace = 8; /* blank cols to leave between problems */
 static int rspace = 8; /* blank rows to leave between problems. Should be
                           more than double the length of maxnum below */
@@ -83,10 +138,12 @@ static int maxnum = 9999; /* length of the longest generated addend. A
                              dividend can be up to twice this long. */
 static int underbarlen = 4; /* should match the number of digits of maxnum */
 
-/* A macro for indexing into the page_buf */
+static int line_len;	/* length of a line of output, with its newline */
+
+/* A macro for indexing into the row buffer of the worksheet sh, at line
+   rowoffset of the box of the problem placed at pl. */
 
-#define BUF_POSITION(row,col,rowoffset) page_buf+((col)-1)*(probcols+cspace)+\
- (((row)-1)*(3+rspace)+(rowoffset))*(cols*(probcols+cspace)+1)
+#define BUF_POSITION(rowoffset) sh->row_buf+pl->off+(rowoffset)*line_len
 
 /* Stuff for the TeX problem generator */
 
@@ -110,13 +167,49 @@ contain blank problems for filling purposes. */
 
 
 
+/* The random number generator. Each worksheet has its own generator
+state, so that worksheets can be made in parallel by -batch. With glibc,
+random_r with a 128 byte state gives the same numbers as srandom/random,
+so a worksheet is the same as the one earlier versions made from the
+same seed. With -D_NO_RANDOM, the POSIX rand_r is used instead. */
+
+struct rng {
 #ifdef _NO_RANDOM
-#define RANDOM rand
-#define SRANDOM srand
+	unsigned state;
 #else
-#define RANDOM random
-#define SRANDOM srandom
+	struct random_data data;
+	char state[128];
 #endif
+};
+
+static void rng_seed(struct rng *r, unsigned seed)
+{
+#ifdef _NO_RANDOM
+	r->state = seed;
+#else
+	memset(&r->data,0,sizeof(r->data));
+	initstate_r(seed,r->state,sizeof(r->state),&r->data);
+#endif
+}
+
+static long rng_next(struct rng *r)
+{
+#ifdef _NO_RANDOM
+	return rand_r(&r->state);
+#else
+	int32_t x;
+
+	random_r(&r->data,&x);
+	return x;
+#endif
+}
+
+struct sheet {
+	FILE *out;
+	char *row_buf;	/* one row of problems, reused for every row */
+	struct rng rng;
+	struct prob *probs;
+};
 
 /* Default values */
 #define INITIAL_SEED 3445
@@ -137,38 +230,297 @@ contain blank problems for filling purposes. */
 
 /* return a number chosen at random from 0,1...,k-1 */
 
-int random_on(int k){
+int random_on(struct rng *r, int k){
 
 	double U;   /* U(0,1) random variable */
 	int rval;
 
-	U = ((double)RANDOM())/((double)_MAX_RAND);
+	U = ((double)rng_next(r))/((double)_MAX_RAND);
 	rval = (int)((double)k*U);
 	return rval;
-} 
+}
+
+/* gen_prob: generate a random problem into *p */
+
+static void gen_prob(struct rng *r, struct prob *p)
+{
+	int arg1, arg2, i;
+
+	/* pick a type of problem */
+
+	p->type = random_on(r,4);
+
+	/* generate random arguments */
+
+	if(p->type == DIV)
+		arg1 = random_on(r,maxnum*maxnum)+1;
+	else
+		arg1 = random_on(r,maxnum)+1;
+	arg2 = random_on(r,maxnum)+1;
+
+	/* we want the larger arg to come first */
+
+	i = arg1;
+
+	arg1 = (arg1 >= arg2 ? arg1 : arg2);
+	arg2 = (arg2 < i ? arg2 : i);
+
+	/* calculate the answer to the problem */
+
+	switch(p->type){
+		case ADD:
+			p->answer = arg1 + arg2;
+			break;
+		case MULT:
+			p->answer = arg1 * arg2;
+			break;
+		case SUB:
+			p->answer = arg1 - arg2;
+			break;
+		case DIV:
+			p->answer = arg1/arg2;
+			break;
+	}
+	p->arg1 = arg1;
+	p->arg2 = arg2;
+}
+
+/* layout: work out where problem i of n goes on a page, into pl */
+
+static void layout(struct place *pl, int i, int n)
+{
+	pl->i = i;
+	pl->row = i/cols+1;
+	pl->col = (i % cols ) + 1;
+	pl->off = (pl->col-1)*(probcols+cspace);
+	pl->first = pl->col == 1;
+	pl->last = pl->col == cols || i == n-1;
+}
+
+/* print_probs: print a page of the n problems p, with or without their
+   answers according to ans, through the backend */
+
+static void print_probs(struct sheet *sh, struct prob *p, int n, int ans)
+{
+	struct place pl;
+	int i;
+
+	for(i=0;i<n;i++){
+		layout(&pl,i,n);
+		if(pl.first && backend->row)
+			backend->row(sh,&pl);
+		backend->prob(sh,&pl,&p[i],ans);
+		if(pl.last && backend->row_end)
+			backend->row_end(sh,&pl);
+	}
+}
+
+/* write_sheet: write the worksheet with the given seed (which is also its
+   version number) to sh->out: a page of nprobs problems, then a page with
+   their answers. date is the date line, as from ctime. */
+
+static void write_sheet(struct sheet *sh, int seed, int nprobs, char *date)
+{
+	int i, ans;
+
+	rng_seed(&sh->rng,(unsigned)seed);
+
+	/* Generate the problems */
+
+	for(i=0;i<nprobs;i++)
+		gen_prob(&sh->rng,&sh->probs[i]);
+
+	if(backend->begin)
+		backend->begin(sh,seed,date);
+	for(ans=NO_ANSWERS;ans<=ANSWERS;ans++){
+		if(backend->page)
+			backend->page(sh,seed,date,ans);
+		print_probs(sh,sh->probs,nprobs,ans);
+		if(backend->page_end)
+			backend->page_end(sh,ans);
+	}
+	if(backend->end)
+		backend->end(sh);
+}
+
+/* sheet_init: get the buffers for worksheets of nprobs problems ready.
+   Returns -1 if out of memory. */
+
+static int sheet_init(struct sheet *sh, int nprobs)
+{
+	sh->row_buf = malloc(row_len+1);
+	sh->probs = malloc(nprobs*sizeof(struct prob));
+	if(sh->row_buf == NULL || sh->probs == NULL){
+		free(sh->row_buf);
+		free(sh->probs);
+		return -1;
+	}
+	return 0;
+}
+
+static void sheet_free(struct sheet *sh)
+{
+	free(sh->row_buf);
+	free(sh->probs);
+}
+
+/* Stuff for -batch: nsheets worksheets with versions seed, seed+1, ...
+   are written to files in dir, named by version. Threads take the next
+   worksheet number from next, under lock. */
+
+struct batch {
+	int nsheets, next, seed, nprobs, failed;
+	char *dir, *date;
+	pthread_mutex_t lock;
+};
+
+static void *batch_work(void *arg)
+{
+	struct batch *b = arg;
+	struct sheet sh;
+	char *path, *obuf;
+	int k, failed = 0;
+
+	path = malloc(strlen(b->dir)+32);
+	obuf = malloc(OUTBUF);
+	if(path == NULL || obuf == NULL || sheet_init(&sh,b->nprobs)){
+		fprintf(stderr,"%s: out of memory\n",PROGNAME);
+		exit(1);
+	}
+	for(;;){
+		pthread_mutex_lock(&b->lock);
+		k = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if(k >= b->nsheets)
+			break;
+		sprintf(path,"%s/%s%d.%s",b->dir,PROGNAME,b->seed+k,
+			backend->ext);
+		if((sh.out = fopen(path,"w")) == NULL){
+			fprintf(stderr,"%s: cannot open %s\n",PROGNAME,path);
+			failed++;
+			continue;
+		}
+		setvbuf(sh.out,obuf,_IOFBF,OUTBUF);
+		write_sheet(&sh,b->seed+k,b->nprobs,b->date);
+		if(fclose(sh.out)){
+			fprintf(stderr,"%s: error writing %s\n",PROGNAME,path);
+			failed++;
+		}
+	}
+	pthread_mutex_lock(&b->lock);
+	b->failed += failed;
+	pthread_mutex_unlock(&b->lock);
+	sheet_free(&sh);
+	free(obuf);
+	free(path);
+	return NULL;
+}
+
+/* run_batch: make the worksheets of b on nthreads threads, and report the
+   rate. Returns the number of worksheets that could not be written. */
+
+static int run_batch(struct batch *b, int nthreads)
+{
+	pthread_t id[MAX_THREADS];
+	struct timespec t0, t1;
+	double secs;
+	int j;
+
+	if(mkdir(b->dir,0777) && errno != EEXIST){
+		fprintf(stderr,"%s: cannot make directory %s\n",PROGNAME,b->dir);
+		return b->nsheets;
+	}
+	pthread_mutex_init(&b->lock,NULL);
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	for(j=1;j<nthreads;j++)
+		if(pthread_create(&id[j],NULL,batch_work,b)){
+			fprintf(stderr,"%s: cannot create thread\n",PROGNAME);
+			exit(1);
+		}
+	batch_work(b);
+	for(j=1;j<nthreads;j++)
+		pthread_join(id[j],NULL);
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	pthread_mutex_destroy(&b->lock);
+	secs = (t1.tv_sec-t0.tv_sec) + 1e-9*(t1.tv_nsec-t0.tv_nsec);
+	fprintf(stderr,"%d worksheets in %.3f s on %d threads: %.1f worksheets/sec\n",
+		b->nsheets-b->failed,secs,nthreads,
+		secs > 0 ? (b->nsheets-b->failed)/secs : 0.0);
+	return b->failed;
+}
+
+/* The output formats. The first is the default. */
+
+static void ascii_page(struct sheet *sh, int seed, char *date, int ans);
+static void row_clear(struct sheet *sh, struct place *pl);
+static void make_prob_ascii(struct sheet *sh, struct place *pl, struct prob *p, int ans);
+static void row_flush(struct sheet *sh, struct place *pl);
+static void tex_begin(struct sheet *sh, int seed, char *date);
+static void tex_page(struct sheet *sh, int seed, char *date, int ans);
+static void make_prob_tex(struct sheet *sh, struct place *pl, struct prob *p, int ans);
+static void tex_page_end(struct sheet *sh, int ans);
+static void tex_end(struct sheet *sh);
+static void html_begin(struct sheet *sh, int seed, char *date);
+static void html_page(struct sheet *sh, int seed, char *date, int ans);
+static void html_row(struct sheet *sh, struct place *pl);
+static void html_prob(struct sheet *sh, struct place *pl, struct prob *p, int ans);
+static void html_row_end(struct sheet *sh, struct place *pl);
+static void html_page_end(struct sheet *sh, int ans);
+static void html_end(struct sheet *sh);
+static void json_begin(struct sheet *sh, int seed, char *date);
+static void json_page(struct sheet *sh, int seed, char *date, int ans);
+static void json_prob(struct sheet *sh, struct place *pl, struct prob *p, int ans);
+static void json_page_end(struct sheet *sh, int ans);
+static void json_end(struct sheet *sh);
+
+static struct backend backends[] = {
+	{"ascii","txt",NULL,ascii_page,row_clear,make_prob_ascii,row_flush,
+		NULL,NULL},
+	{"tex","tex",tex_begin,tex_page,NULL,make_prob_tex,NULL,
+		tex_page_end,tex_end},
+	{"html","html",html_begin,html_page,html_row,html_prob,html_row_end,
+		html_page_end,html_end},
+	{"json","json",json_begin,json_page,NULL,json_prob,NULL,
+		json_page_end,json_end},
+	{NULL}
+};
 
 int
 main(int argc, char **argv){
 
 	int i=1;
-	int output_type = ASCII;
 	int nprobs = NPROBS;
-	int row=1,col=1;
-	int seed = 0; 
-	int type;
+	int seed = 0;
+	int nsheets = 0, nthreads = 0;
+	char *dir = ".";
+	char date[64];
+	struct sheet sh;
+	struct batch b;
 	time_t timenow;
 
 
 	timenow = time(NULL); /* time stamp */
+	strcpy(date,ctime(&timenow));
 
-	make_prob = make_prob_ascii;
+	backend = &backends[0];
 
 	/* Process command line */
 	while((i<argc) && (argv[i][0]=='-')){
 		switch(argv[i][1]){
 		case 't':
-			output_type = TEX;
-			make_prob = make_prob_tex;
+			backend = &backends[1];
+			break;
+		case 'f':
+			/* store next arg as output format */
+			for(backend=backends;backend->name;backend++)
+				if(argv[i+1] && strcmp(backend->name,argv[i+1]) == 0)
+					break;
+			if(backend->name == NULL){
+				fprintf(stderr,"%s: unknown format %s\n",PROGNAME,
+					argv[i+1] ? argv[i+1] : "");
+				return 1;
+			}
+			i++;
 			break;
 		case 'v':
 			printf("%s\n",VERSION);
@@ -191,6 +543,19 @@ main(int argc, char **argv){
 			seed = atoi(argv[i+1]);
 			i++;
 			break;
+		case 'b':
+			/* store next arg as number of worksheets */
+			nsheets = atoi(argv[i+1]);
+			i++;
+			break;
+		case 'o':
+			dir = argv[i+1];
+			i++;
+			break;
+		case 'j':
+			nthreads = atoi(argv[i+1]);
+			i++;
+			break;
 		default:
 			fprintf(stderr,"%s:%s\n",PROGNAME,USAGE);
 			return 1;
@@ -204,11 +569,11 @@ main(int argc, char **argv){
 	}
 
 
-	/* Do a sanity check on the parameters. We will write our page of
-           problems into the global array page_buf, then dump that to stdout
-           afterwards. We don't want to overflow that buffer */
+	/* Do a sanity check on the parameters. We will write each row of
+           problems into a row buffer, then dump that to the output
+           before starting the next. */
 
-	if(cols <= 0) {
+	if(cols <= 0 || cols > (1<<20)) {
 		fprintf(stderr,"cols parameter = %d, a crazy value\n",cols);
 		exit(1);
 	}
@@ -217,165 +582,117 @@ main(int argc, char **argv){
 		exit(1);
 	}
 
-	/* how many rows of problems ? */
-
-	i = nprobs/cols + 1;    /* upper bound */
+	/* one row of problems: 3+rspace lines of cols boxes each, plus
+	   the newline. (The sprintf's in make_prob_ascii write a null one
+	   past the end of a box; the extra byte is room for it.) */
 
-	if( i*(3+rspace)*((probcols+cspace)+1)+1 >= BUFFER_SIZE ){
-		fprintf(stderr,"Internal buffer too small for problem set size\n");
-		fprintf(stderr,"Tone down request, or compile with bigger buffer\n");
-		exit(1);
-	} 
+	line_len = cols*(probcols+cspace)+1;
+	row_len = (3+rspace)*line_len;
 
 	/* Seed the random number generator */
 
 	/* If no seed is supplied, then use current system time */
-	
+
 	if(!seed)
 		if((seed = (long)time(NULL)) == -1){
 			seed = INITIAL_SEED; /* if all else fails */
 			fprintf(stderr, "Warning: no seed available. Using %d\n",INITIAL_SEED);
 		}
-		
-	SRANDOM((unsigned)seed);
-
-	if(output_type == ASCII ){
-
-	/* print the date and version number 
-                         of problem set (i.e, the seed ) */
-
-		printf("\n\nDate: %sVersion: %d\n",ctime(&timenow),seed);
-	
-		/* print the banner */
 
-		printf("%s", BANNER);
+	if(nsheets > 0){
+		if(nthreads <= 0)
+			nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if(nthreads <= 0)
+			nthreads = 1;
+		if(nthreads > MAX_THREADS)
+			nthreads = MAX_THREADS;
+		b.nsheets = nsheets;
+		b.next = 0;
+		b.seed = seed;
+		b.nprobs = nprobs;
+		b.failed = 0;
+		b.dir = dir;
+		b.date = date;
+		return run_batch(&b,nthreads) ? 1 : 0;
 	}
-	else {
 
-		printf(TEX_DOC_HEADER);
-		printf("\\today \\ \\ (Version %d.) See attached page for answers.\n \n",
-				seed);
-		printf("\\nopagebreak\n\n");
-		printf(TEX_PAGE_HEADER);
+	if(sheet_init(&sh,nprobs)){
+		fprintf(stderr,"Not enough memory for %d problems\n",nprobs);
+		exit(1);
 	}
+	sh.out = stdout;
+	setvbuf(stdout,NULL,_IOFBF,OUTBUF);
+	write_sheet(&sh,seed,nprobs,date);
+	return 0;
 
-		/* Generate the problems */
-
-	for(i=0;i<nprobs;i++){
-		row = i/cols+1;
-		col = (i % cols ) + 1;
-
-		/* pick a type of problem */
-		
-		type = random_on(4); 
-
-		make_prob(row,col,type,NO_ANSWERS);
-	}
+}
 
-	if(output_type == ASCII){
 
-	/* print the whole thing out */
+/* The ASCII backend. Each row of problems is drawn into the row buffer by
+   make_prob_ascii, then written out in one piece. */
 
-		printf("%s",page_buf);
+static void ascii_page(struct sheet *sh, int seed, char *date, int ans)
+{
+	if(ans == NO_ANSWERS){
 
-	/* printf a formfeed, then the whole thing over, this time
-                with answers */
+		/* print the date and version number
+                         of problem set (i.e, the seed ), then the banner */
 
-		printf("\f");  
-		printf("\n\nDate: %sVersion: %d\n",ctime(&timenow),seed);
-		printf("Solutions:\n\n\n\n\n\n");
+		fprintf(sh->out,"\n\nDate: %sVersion: %d\n",date,seed);
+		fputs(BANNER,sh->out);
 	}
 	else {
 
-		printf(TEX_PAGE_FOOTER);
-		printf("\n\\pagebreak\n\n");
-		printf("\\date \\ \\ (Version %d)\n \n",seed);
-		printf("\\nopagebreak\n");
-		printf(TEX_PAGE_HEADER);
-	}
+		/* a formfeed, then the whole thing over, this time
+                with answers */
 
-	SRANDOM((unsigned)seed); /* so we'll get the same problems again */
+		putc('\f',sh->out);
+		fprintf(sh->out,"\n\nDate: %sVersion: %d\n",date,seed);
+		fputs("Solutions:\n\n\n\n\n\n",sh->out);
+	}
+}
 
-	for(i=0;i<nprobs;i++){
-		row = i/cols+1;
-		col = (i % cols ) + 1;
+/* Blank the row buffer: all spaces, with a newline ending each line, so
+   that problems missing from the last row are left blank. */
 
-		/* pick a type of problem */
-		
-		type = random_on(4); 
+static void row_clear(struct sheet *sh, struct place *pl)
+{
+	int i;
 
-		make_prob(row,col,type,ANSWERS);
-	}
+	(void)pl;
+	memset(sh->row_buf,' ',row_len);
+	for(i=line_len-1;i<row_len;i+=line_len)
+		sh->row_buf[i] = '\n';
+}
 
-	if(output_type == ASCII)
-		printf("%s",page_buf);
-	else {
-		printf(TEX_PAGE_FOOTER);
-		printf(TEX_DOC_FOOTER);
-	}
-	return 0;	
+/* Write the row buffer out */
 
+static void row_flush(struct sheet *sh, struct place *pl)
+{
+	(void)pl;
+	fwrite(sh->row_buf,1,row_len,sh->out);
 }
 
-
 /* make_prob_ascii: Does the hard work. Writes a (3+rspace)x(probcol+cspace) box 
-containing a randomly generated problem of the given type. The global buffer
-page_buf can be thought of as containing an array of such boxes. This 
-routine writes the (i,j)-th such box, with i=row, j=col passed.
+containing the problem p. The buffer sh->row_buf can be thought of as
+containing a row of such boxes. This routine writes the box of the problem
+placed at pl.
 
 If the ans parameter is set to ANSWERS then the answer to the problem is
 written too.
 
 */
 
-int make_prob_ascii(int row, int col, int type, int ans) 
+static void make_prob_ascii(struct sheet *sh, struct place *pl, struct prob *p, int ans)
 {
 
-	int arg1, arg2;
-	int answer;
-	int xtra,xtra_save,l,i,j;
+	int arg1 = p->arg1, arg2 = p->arg2;
+	int answer = p->answer;
+	int type = p->type;
+	int xtra,xtra_save,l=0,i,j;
 	char lbuf[128];
 	char *bptr;
 
-	/* generate random arguments */
-
-	if(type == DIV)
-		arg1 = random_on(maxnum*maxnum)+1;
-	else
-		arg1 = random_on(maxnum)+1;
-	arg2 = random_on(maxnum)+1;
-
-	/* we want the larger arg to come first */
-
-	i = arg1;
-
-	arg1 = (arg1 >= arg2 ? arg1 : arg2);	
-	arg2 = (arg2 < i ? arg2 : i);
-
-	/* calculate the answer to the problem here, if needed */ 
-
-	if(ans == ANSWERS){
-		
-		switch(type){
-			case ADD:
-				answer = arg1 + arg2;
-				break;
-			case MULT:
-				answer = arg1 * arg2;
-				break;
-			case SUB:
-				answer = arg1 - arg2;
-				break;
-			case DIV:
-				answer = arg1/arg2;
-				break;
-			default:
-				fprintf(stderr,"make_prob: called with screwy problem type\n");
-				exit(1);
-		}
-
-	}
-	
 	switch(type){
 		case ADD: /* these have same format, except for operation sign*/
 		case MULT:
@@ -385,7 +702,7 @@ int make_prob_ascii(int row, int col, int type, int ans)
 	/* locate initial buffer position of upper left corner of problem
                   output rectangle */
 
-		bptr = BUF_POSITION(row,col,0); 
+		bptr = BUF_POSITION(0); 
 
 		/* create a right justified string for top operand */
 
@@ -415,17 +732,17 @@ int make_prob_ascii(int row, int col, int type, int ans)
 
 		/* if we are last problem in a column we must print newline */
 
-		if(col == cols)
+		if(pl->col == cols)
 			*(bptr++)='\n';
 
 /* The above operation is done many times, so we make a macro of it here */
 #define FINISH_LINE for(i=0;i<cspace;i++)*(bptr++)=' ';\
-if(col==cols)*(bptr++)='\n';
+if(pl->col==cols)*(bptr++)='\n';
 
 
 		/* position for next row */
 
-		bptr = BUF_POSITION(row,col,1); 
+		bptr = BUF_POSITION(1); 
 
 		/* repeat with second arg */
 
@@ -483,7 +800,7 @@ if(col==cols)*(bptr++)='\n';
 
 		/* position for underbar */
 
-		bptr = BUF_POSITION(row,col,2); 
+		bptr = BUF_POSITION(2); 
 
 		/* now draw the underbar */
 
@@ -498,7 +815,7 @@ if(col==cols)*(bptr++)='\n';
 
 		if(ans == ANSWERS){  /* draw answer below underbar */
 
-			bptr = BUF_POSITION(row,col,3); 
+			bptr = BUF_POSITION(3); 
 
 			sprintf(lbuf,"%d",answer);
 			l = strlen(lbuf);
@@ -524,7 +841,7 @@ if(col==cols)*(bptr++)='\n';
 
 		case DIV:
 
-			bptr = BUF_POSITION(row,col,0);
+			bptr = BUF_POSITION(0);
 
 			/* answer goes on line 0 of box, else blank line  */
 
@@ -548,7 +865,7 @@ if(col==cols)*(bptr++)='\n';
 
 			/* print the overbar */
 
-			bptr = BUF_POSITION(row,col,1);
+			bptr = BUF_POSITION(1);
 
 			sprintf(lbuf,"%d",arg1);
 			l = strlen(lbuf);  
@@ -565,7 +882,7 @@ if(col==cols)*(bptr++)='\n';
 
 			/* print the main problem line */
 
-			bptr = BUF_POSITION(row,col,2);
+			bptr = BUF_POSITION(2);
 
 			sprintf(lbuf,"%d|%d",arg2,arg1);
 			l = strlen(lbuf);
@@ -592,16 +909,15 @@ if(col==cols)*(bptr++)='\n';
 	else i = 0;
 	for(;i<rspace;i++){
 
-			bptr = BUF_POSITION(row,col,(3+i)); 
+			bptr = BUF_POSITION(3+i); 
 
 			for(j=0;j<probcols+cspace;j++)
 				*(bptr++) = ' ';
 
-			if(col == cols)
+			if(pl->col == cols)
 				*(bptr++)='\n';
 	}
 		
-	return 0;
 }
 
 /* make_prob_tex: Does the hard work of writing pages of TeX source 
@@ -628,53 +944,14 @@ written too.
 /* you have to read through the source for other things that affect 
 formatting */
 
-int make_prob_tex(int row, int col, int type, int ans) 
+static void make_prob_tex(struct sheet *sh, struct place *pl, struct prob *p, int ans)
 {
 
-	int arg1, arg2;
-	int answer;
+	int arg1 = p->arg1, arg2 = p->arg2;
+	int answer = p->answer;
+	int type = p->type;
 	int xtra,i;
 	char lbuf[128];
-	char *bptr;
-
-	/* generate random arguments */
-
-	if(type == DIV)
-		arg1 = random_on(maxnum*maxnum)+1;
-	else
-		arg1 = random_on(maxnum)+1;
-	arg2 = random_on(maxnum)+1;
-
-	/* we want the larger arg to come first */
-
-	i = arg1;
-
-	arg1 = (arg1 >= arg2 ? arg1 : arg2);	
-	arg2 = (arg2 < i ? arg2 : i);
-
-	/* calculate the answer to the problem here, if needed */ 
-
-	if(ans == ANSWERS){
-		
-		switch(type){
-			case ADD:
-				answer = arg1 + arg2;
-				break;
-			case MULT:
-				answer = arg1 * arg2;
-				break;
-			case SUB:
-				answer = arg1 - arg2;
-				break;
-			case DIV:
-				answer = arg1/arg2;
-				break;
-			default:
-				fprintf(stderr,"make_prob: called with screwy problem type\n");
-				exit(1);
-		}
-
-	}
 
 	/* Multiplication, subtraction and addition have a similar format. We
            handle division separately below. */
@@ -683,38 +960,38 @@ int make_prob_tex(int row, int col, int type, int ans)
 
 		/* print a placeholder line of the right column width */
 
-		printf(PROBM_HEADER);
-		printf(COLUMN_HEADER);
-		printf("%d\\\\\n",arg1);
+		fputs(PROBM_HEADER,sh->out);
+		fputs(COLUMN_HEADER,sh->out);
+		fprintf(sh->out,"%d\\\\\n",arg1);
 
 		switch(type){
 			case ADD: /* these have same format, except for operation sign*/
-				printf("+\\ ");
+				fputs("+\\ ",sh->out);
 				break;
 			case SUB:
-				printf("-\\ ");
+				fputs("-\\ ",sh->out);
 				break;
 			case MULT:
-				printf("$\\times$\\ ");
+				fputs("$\\times$\\ ",sh->out);
 				break;
 		}
-		printf("%d\\\\ \n",arg2);
+		fprintf(sh->out,"%d\\\\ \n",arg2);
 		if(ans == ANSWERS)
-			printf("\\hline\n%d\n",answer);
+			fprintf(sh->out,"\\hline\n%d\n",answer);
 		else
-			printf("\\hline\n\\  \n");
-		printf(PROBM_FOOTER);
-		printf("\n");
+			fputs("\\hline\n\\  \n",sh->out);
+		fputs(PROBM_FOOTER,sh->out);
+		fputs("\n",sh->out);
 	}
 	else if(type == DIV){
-		printf(PROBD_HEADER);
+		fputs(PROBD_HEADER,sh->out);
 		if(ans == ANSWERS){
 
 			/* The answer comes on top in a division problem. */
 			/* Leave 4 spaces room above the divisor. This crude
                            and should be fixed. It assumes the divisor is 4
                            digits, but about 10% of the time it is less */
-			printf("\\ \\ \\ \\ &");
+			fputs("\\ \\ \\ \\ &",sh->out);
 
 			/* Determine how many digits in the answer, then put
                            it enough hard spaces so it will be roughly right.
@@ -723,20 +1000,20 @@ int make_prob_tex(int row, int col, int type, int ans)
 			sprintf(lbuf,"%d",answer);
 			xtra = 9 - strlen(lbuf);
 			for(i=0;i<xtra;i++)
-				printf("\\ ");
+				fputs("\\ ",sh->out);
 			/* print the answer and the overbar */
-			printf("%d",answer);
-			printf(" \\\\ \\cline{2-2}\n");
+			fprintf(sh->out,"%d",answer);
+			fputs(" \\\\ \\cline{2-2}\n",sh->out);
 		}
 		else  /* if no answer, print a big blank line with the problem
                          overbar under the last 8 spaces. It will end up
                          over the dividend. */
-			printf("\\ \\ \\ \\ &\\ \\ \\ \\ \\ \\ \\ \\ \\\\ \\cline{2-2}\n");
+			fputs("\\ \\ \\ \\ &\\ \\ \\ \\ \\ \\ \\ \\ \\\\ \\cline{2-2}\n",sh->out);
 
 		/* make the divisor|dividend line */
-		printf(DIV_DIV_LINE,arg2,arg1);
-		printf(PROBD_FOOTER);
-		printf("\n");
+		fprintf(sh->out,DIV_DIV_LINE,arg2,arg1);
+		fputs(PROBD_FOOTER,sh->out);
+		fputs("\n",sh->out);
 	}
 	else {  /* of course, this should never happen */
 
@@ -750,17 +1027,180 @@ int make_prob_tex(int row, int col, int type, int ans)
            row. Note that it is here that we handle placement of alignment
            tabs for the big table. */
 
-	if(col == cols)
-		printf("\\\\ [1.3 in]");
+	if(pl->col == cols)
+		fputs("\\\\ [1.3 in]",sh->out);
 	else { /* print blank problem as separator  */
-		printf(" & ");        /* tab for big table */
-		printf(PROBM_HEADER);
-		printf(COLUMN_HEADER);
-		printf("\\ \\\\ \n \\ \\\\ \n \\ \\\\ \n \\\\ \n");
-		printf(PROBM_FOOTER);
-		printf(" & \n");    /* next tag for big table */
+		fputs(" & ",sh->out);        /* tab for big table */
+		fputs(PROBM_HEADER,sh->out);
+		fputs(COLUMN_HEADER,sh->out);
+		fputs("\\ \\\\ \n \\ \\\\ \n \\ \\\\ \n \\\\ \n",sh->out);
+		fputs(PROBM_FOOTER,sh->out);
+		fputs(" & \n",sh->out);    /* next tag for big table */
 	}
-	printf("\n");
-	return 0;
+	fputs("\n",sh->out);
 }
 
+/* The rest of the TeX backend */
+
+static void tex_begin(struct sheet *sh, int seed, char *date)
+{
+	(void)seed;
+	(void)date;
+	fputs(TEX_DOC_HEADER,sh->out);
+}
+
+static void tex_page(struct sheet *sh, int seed, char *date, int ans)
+{
+	(void)date;
+	if(ans == NO_ANSWERS){
+		fprintf(sh->out,"\\today \\ \\ (Version %d.) See attached page for answers.\n \n",
+				seed);
+		fputs("\\nopagebreak\n\n",sh->out);
+	}
+	else {
+		fputs("\n\\pagebreak\n\n",sh->out);
+		fprintf(sh->out,"\\date \\ \\ (Version %d)\n \n",seed);
+		fputs("\\nopagebreak\n",sh->out);
+	}
+	fputs(TEX_PAGE_HEADER,sh->out);
+}
+
+static void tex_page_end(struct sheet *sh, int ans)
+{
+	(void)ans;
+	fputs(TEX_PAGE_FOOTER,sh->out);
+}
+
+static void tex_end(struct sheet *sh)
+{
+	fputs(TEX_DOC_FOOTER,sh->out);
+}
+
+/* The HTML backend. The page is a table with a cell for each problem;
+   the style sheet below right justifies the numbers and draws the bars.
+   The answer page starts on a new sheet of paper when printed. */
+
+#define HTML_STYLE "body { font-family: monospace; font-size: 14pt; }\n\
+td.p { text-align: right; vertical-align: top; padding: 0 4em 6em 0; }\n\
+.bar { display: block; border-top: 1px solid; }\n\
+.dd { border-top: 1px solid; border-left: 1px solid; padding-left: 2px; }\n\
+h2.answers { page-break-before: always; }\n"
+
+static void html_begin(struct sheet *sh, int seed, char *date)
+{
+	(void)date;
+	fprintf(sh->out,"<!DOCTYPE html>\n<html>\n<head>\n\
+<meta charset=\"utf-8\">\n<title>Arithmetic problems, version %d</title>\n\
+<style>\n%s</style>\n</head>\n<body>\n",seed,HTML_STYLE);
+}
+
+static void html_page(struct sheet *sh, int seed, char *date, int ans)
+{
+	if(ans == NO_ANSWERS)
+		fputs("<h2>Do the following arithmetic problems:</h2>\n",sh->out);
+	else
+		fputs("<h2 class=\"answers\">Solutions:</h2>\n",sh->out);
+	fprintf(sh->out,"<p>Date: %.*s<br>Version: %d%s</p>\n<table>\n",
+		(int)strcspn(date,"\n"),date,seed,
+		ans == NO_ANSWERS ? " (Answers on next page.)" : "");
+}
+
+static void html_row(struct sheet *sh, struct place *pl)
+{
+	(void)pl;
+	fputs("<tr>",sh->out);
+}
+
+static void html_prob(struct sheet *sh, struct place *pl, struct prob *p, int ans)
+{
+	(void)pl;
+	switch(p->type){
+		case ADD:
+		case SUB:
+		case MULT:
+			fprintf(sh->out,"<td class=\"p\">%d<br>%s&nbsp;%d<span class=\"bar\">",
+				p->arg1,
+				p->type == ADD ? "+" : p->type == SUB ? "&minus;" : "&times;",
+				p->arg2);
+			if(ans == ANSWERS)
+				fprintf(sh->out,"%d</span></td>",p->answer);
+			else
+				fputs("&nbsp;</span></td>",sh->out);
+			break;
+		case DIV:
+			if(ans == ANSWERS)
+				fprintf(sh->out,"<td class=\"p\">%d<br>",p->answer);
+			else
+				fputs("<td class=\"p\">&nbsp;<br>",sh->out);
+			fprintf(sh->out,"%d<span class=\"dd\">%d</span></td>",
+				p->arg2,p->arg1);
+			break;
+		default:
+			fprintf(stderr,"html_prob: unknown problem type\n");
+			exit(1);
+	}
+}
+
+static void html_row_end(struct sheet *sh, struct place *pl)
+{
+	(void)pl;
+	fputs("</tr>\n",sh->out);
+}
+
+static void html_page_end(struct sheet *sh, int ans)
+{
+	(void)ans;
+	fputs("</table>\n",sh->out);
+}
+
+static void html_end(struct sheet *sh)
+{
+	fputs("</body>\n</html>\n",sh->out);
+}
+
+/* The JSON backend, for other programs. A worksheet is one object:
+
+   {"version":V,"date":"...","pages":[
+   {"answers":false,"problems":[
+   {"row":1,"col":1,"op":"+","a":4121,"b":310},
+   ...]},
+   {"answers":true,"problems":[
+   {"row":1,"col":1,"op":"+","a":4121,"b":310,"answer":4431},
+   ...]}]}
+
+   op is one of + - * /. */
+
+static void json_begin(struct sheet *sh, int seed, char *date)
+{
+	fprintf(sh->out,"{\"version\":%d,\"date\":\"%.*s\",\"pages\":[",
+		seed,(int)strcspn(date,"\n"),date);
+}
+
+static void json_page(struct sheet *sh, int seed, char *date, int ans)
+{
+	(void)seed;
+	(void)date;
+	fprintf(sh->out,"%s\n{\"answers\":%s,\"problems\":[",
+		ans == NO_ANSWERS ? "" : ",",
+		ans == NO_ANSWERS ? "false" : "true");
+}
+
+static void json_prob(struct sheet *sh, struct place *pl, struct prob *p, int ans)
+{
+	fprintf(sh->out,"%s\n{\"row\":%d,\"col\":%d,\"op\":\"%c\",\"a\":%d,\"b\":%d",
+		pl->i ? "," : "",pl->row,pl->col,"+-*/"[p->type],p->arg1,p->arg2);
+	if(ans == ANSWERS)
+		fprintf(sh->out,",\"answer\":%d",p->answer);
+	putc('}',sh->out);
+}
+
+static void json_page_end(struct sheet *sh, int ans)
+{
+	(void)ans;
+	fputs("]}",sh->out);
+}
+
+static void json_end(struct sheet *sh)
+{
+	fputs("]}\n",sh->out);
+}
@@ -77,17 +77,28 @@
  *  runs through the array and changes the state (i.e., various fields) of
  *  each machine struct according to the contents of its neighbors. A brief
  *  summary of the state of each machine is printed to stdout.
+ *
+ *  Long runs can be checkpointed with -checkpoint file [-every k]. Every k
+ *  steps the step counter and the state of all machines are written to file
+ *  in the compact binary format described above save_state below, and the
+ *  run can be continued later with -resume file. Since the format depends
+ *  only on the machine states, two checkpoint files taken at the same step
+ *  can be compared byte for byte (e.g., with cmp) to check that two
+ *  implementations of the machines agree.
  */
 
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<unistd.h>
 
 #define VERSION "1.0"
 #define DEFAULT_LENGTH 8
 #define MAX_LENGTH 1024
+#define DEFAULT_EVERY 100
 
-#define USAGE "fsquad [-hlv -t <n> -n <n> -d <n> ]"
+#define USAGE "fsquad [-hlv -t <n> -n <n> -d <n> -checkpoint <file> -every <n>\n\
+	-resume <file> ]"
 
 #ifdef _SHORT_STRINGS
 #define HELP USAGE
@@ -99,6 +110,9 @@
 -t: run the simulation for at most n time steps.\n\
 -n: Simulate a firing squad of length n (Default = 9)\n\
 -d: Delay d seconds between cycles. (Default is to run at full speed.)\n\
+-checkpoint: save the simulation state to file periodically.\n\
+-every: checkpoint every n time steps. (Default = 100)\n\
+-resume: continue the simulation from the state saved in file.\n\
 \nSimulate solution of firing squad synchronization problem.\n\n"
 #endif
 
@@ -146,6 +160,9 @@ int N = DEFAULT_LENGTH;
 void print_state(void);
 void update_state(int j);
 void legend(void);
+int save_state(char *file, int t);
+int load_header(FILE *fp, int *t);
+int load_machines(FILE *fp);
 
 int
 main(int argc, char **argv)
@@ -153,6 +170,10 @@ main(int argc, char **argv)
 	int i=1,j=1,t=1;
 	int fire,delay = 0;
 	int maxsteps = -1;
+	int every = DEFAULT_EVERY;
+	int n_given = 0;
+	char *checkpoint = NULL, *resume = NULL;
+	FILE *resume_fp = NULL;
 
 	/* Process command line options */
 
@@ -167,6 +188,7 @@ main(int argc, char **argv)
 		  }
 		  if(strcmp(argv[i],"-n")==0){
 			N = atoi(argv[i+1]);
+			n_given = N;
 			i += 2;
 			continue;
 		  }
@@ -185,12 +207,49 @@ main(int argc, char **argv)
 			i += 2;
 			continue;
 		  }
+		  if(strcmp(argv[i],"-checkpoint")==0){
+			checkpoint = argv[i+1];
+			i += 2;
+			continue;
+		  }
+		  if(strcmp(argv[i],"-every")==0){
+			every = atoi(argv[i+1]);
+			i += 2;
+			continue;
+		  }
+		  if(strcmp(argv[i],"-resume")==0){
+			resume = argv[i+1];
+			i += 2;
+			continue;
+		  }
 		  fprintf(stderr, "fsquad: Unknown option %s\n", argv[i]);
 		  fprintf(stderr, "%s\n",USAGE);
 		  return 1;
 	}
 
-	/* Sanity checks, and instantiate machines */
+	/* Sanity checks, and instantiate machines. When resuming, the
+	 * length of the squad and the step counter come from the file. */
+
+	if(every <= 0){
+		fprintf(stderr,"fsquad: checkpoint interval must be positive\n");
+		return 1;
+	}
+	if(resume){
+		if(!(resume_fp = fopen(resume,"rb"))){
+			fprintf(stderr,"fsquad: cannot open %s\n",resume);
+			return 1;
+		}
+		if(load_header(resume_fp,&t)){
+			fprintf(stderr,"fsquad: %s is not an fsquad checkpoint\n",
+					resume);
+			return 1;
+		}
+		if(n_given && n_given != N){
+			fprintf(stderr,"fsquad: -n %d, but %s has %d machines\n",
+					n_given,resume,N);
+			return 1;
+		}
+	}
 
 	if(N <= 0 || N > MAX_LENGTH){
 		fprintf(stderr,"fsquad: Requested length not in supported range 1-%d\n",MAX_LENGTH);
@@ -234,10 +293,20 @@ main(int argc, char **argv)
 	machines[N-1]->message = NO_MSG;
 	machines[N-1]->testing = FALSE;
 
+	/* ... unless we are continuing from a checkpoint */
+
+	if(resume_fp){
+		if(load_machines(resume_fp)){
+			fprintf(stderr,"fsquad: %s is truncated or corrupt\n",
+					resume);
+			return 1;
+		}
+		fclose(resume_fp);
+	}
+
 	/* main loop: do one time step of the simulation */
 
 	print_state();
-	t = 1;
 	while(TRUE){
 
 		/* store current state in machines_old array */
@@ -267,6 +336,12 @@ main(int argc, char **argv)
 			break;
 		}
 		t++;
+		if(checkpoint && ((t-1) % every == 0))
+			if(save_state(checkpoint,t)){
+				fprintf(stderr,"fsquad: cannot write checkpoint %s\n",
+						checkpoint);
+				return 1;
+			}
 		sleep(delay);
 		if(maxsteps > 0)maxsteps--;
 	}
@@ -634,6 +709,121 @@ void update_state(int j){
 }
 
 
+/* Checkpoint file format. All machine fields are small enumerations (the
+ * timer never exceeds 3), so each machine is stored as one byte per field:
+ *
+ *	bytes 0-3:	magic "FSQD"
+ *	byte  4:	format version (CHECKPOINT_VERSION)
+ *	bytes 5-8:	N, little endian
+ *	bytes 9-12:	t, the step counter, little endian
+ *	then N records of CHECKPOINT_FIELDS bytes, in the order of the
+ *	fields of struct machine.
+ *
+ * The state is first written to file.tmp and then renamed over file, so an
+ * interrupted run always leaves a complete checkpoint behind. Returns 0 on
+ * success, 1 on failure. */
+
+#define CHECKPOINT_MAGIC "FSQD"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER 13
+#define CHECKPOINT_FIELDS 7
+
+static void put32(unsigned char *p, int v){
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static int get32(unsigned char *p){
+
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+int save_state(char *file, int t){
+
+	unsigned char buf[CHECKPOINT_HEADER + CHECKPOINT_FIELDS*MAX_LENGTH];
+	unsigned char *p;
+	char tmp[FILENAME_MAX];
+	FILE *fp;
+	int i,n;
+
+	memcpy(buf,CHECKPOINT_MAGIC,4);
+	buf[4] = CHECKPOINT_VERSION;
+	put32(buf+5,N);
+	put32(buf+9,t);
+	p = buf + CHECKPOINT_HEADER;
+	for(i=0;i<N;i++){
+		*p++ = machines[i]->activity;
+		*p++ = machines[i]->timer;
+		*p++ = machines[i]->color;
+		*p++ = machines[i]->type;
+		*p++ = machines[i]->message_direction;
+		*p++ = machines[i]->message;
+		*p++ = machines[i]->testing;
+	}
+	n = p - buf;
+
+	if(snprintf(tmp,FILENAME_MAX,"%s.tmp",file) >= FILENAME_MAX)
+		return 1;
+	if(!(fp = fopen(tmp,"wb")))return 1;
+	if(fwrite(buf,1,n,fp) != (size_t)n){
+		fclose(fp);
+		remove(tmp);
+		return 1;
+	}
+	if(fclose(fp))return 1;
+	return rename(tmp,file) ? 1 : 0;
+}
+
+/* Read the header of a checkpoint file, setting N and the step counter.
+ * Returns 0 on success, 1 if this is not a checkpoint we understand. */
+
+int load_header(FILE *fp, int *t){
+
+	unsigned char buf[CHECKPOINT_HEADER];
+
+	if(fread(buf,1,CHECKPOINT_HEADER,fp) != CHECKPOINT_HEADER)return 1;
+	if(memcmp(buf,CHECKPOINT_MAGIC,4))return 1;
+	if(buf[4] != CHECKPOINT_VERSION)return 1;
+	N = get32(buf+5);
+	*t = get32(buf+9);
+	if(*t < 1)return 1;
+	return 0;
+}
+
+/* Read the machine records following the header into the (already
+ * allocated) machines array. Each field must lie in the range
+ * update_state uses it in. The exception is the message direction: a
+ * machine with nothing to send is left with whatever dir held, and any
+ * value past BROADCAST just points nowhere, so it is stored as
+ * BROADCAST+1. Returns 0 on success, 1 on failure. */
+
+int load_machines(FILE *fp){
+
+	static const unsigned char max[CHECKPOINT_FIELDS] = {
+		ACTIVE, 3, BLACK, SOLDIER, 255, PROMOTE_MSG, TRUE };
+	unsigned char rec[CHECKPOINT_FIELDS];
+	int i,k;
+
+	for(i=0;i<N;i++){
+		if(fread(rec,1,CHECKPOINT_FIELDS,fp) != CHECKPOINT_FIELDS)
+			return 1;
+		for(k=0;k<CHECKPOINT_FIELDS;k++)
+			if(rec[k] > max[k])return 1;
+		machines[i]->activity = rec[0];
+		machines[i]->timer = rec[1];
+		machines[i]->color = rec[2];
+		machines[i]->type = rec[3];
+		machines[i]->message_direction =
+			rec[4] > BROADCAST ? BROADCAST+1 : rec[4];
+		machines[i]->message = rec[5];
+		machines[i]->testing = rec[6];
+	}
+	return 0;
+}
+
 void legend(void){
 
 	printf("\n\nMachine State Legend\n\n");
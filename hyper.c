@@ -20,17 +20,26 @@
   	F(a,b,c;x) = (1-x)^(-a) F(a,c-b,c,x/(x-1)).
    
    Since the transformation x -> x/(x-1) maps the half plane Re(x) < 1/2 onto
-   the unit disc, mapping 0 to 0, the cases below allow us to calculate F for 
-   all x from minus infinity to 1 by ultimately summing a series:
-
-  	case: x <= 0: Apply x -> x/(x-1) and then sum.
-        case: x > 0:  Sum	
+   the unit disc, mapping 0 to 0, this allows us to calculate F for all x
+   from minus infinity to 1 by ultimately summing a series. However, the
+   series converges very slowly when its variable is close to 1, which
+   happens for x near 1 and for large negative x. There are further
+   identities expressing F(a,b,c;x) as a combination, with coefficients
+   made of gamma functions and powers, of two hypergeometric functions
+   in one of the variables 1-x, 1/x or 1/(1-x). Between them, x/(x-1) and
+   these map every real x other than 1 into [0,1/2], where the series
+   converges at least geometrically with ratio 1/2. See hyperreduce below
+   for the cases, and for what we compute for x >= 1.
 
    For background on the hypergeometric function, including proofs of all the
    above statements, see, e.g., Special Functions and Their Applications, by
    N.N. Lebedev and Richard R. Silverman, Dover, NY, 1972, pp. 238-250.
 
-   Compile: cc -o hyper hyper.c -lm
+   Compile: cc -o hyper hyper.c -lm -lpthread
+
+   To add the __float128 precision (GCC only), compile with
+
+	cc -DQUAD -o hyper hyper.c -lquadmath -lm -lpthread
 
    For usage information, give the command hyper -h or see USAGE defined
    below.
@@ -40,7 +49,49 @@
 	extern double hyper(double a, double a, double c, double x, 
 		double derror);
 
-   Compile this file with cc -c -DNO_MAIN and link your program with hyper.o
+	extern double hypern(double a, double b, double c, double x,
+		double derror, int *terms);
+
+	extern void hypergrid(int m, double *a, double *b, double *c,
+		double *x, double derror, double *f, int *terms);
+
+   hypern is hyper, but also reports the number of series terms summed.
+
+   hypergrid computes f[i] = F(a[i],b[i],c[i];x[i]) for i = 0,...,m-1. It
+   gives the same values as calling hyper m times, but sums HYPER_LANES
+   series in lockstep so that the compiler can evaluate them with SIMD
+   instructions. It is used to generate tables. Pass terms = NULL if the
+   term counts are not wanted.
+
+	extern double hyperp(double a, double b, double c, double x,
+		double derror, int prec, int *terms);
+
+   hyperp is hypern computed in one of the precisions PREC_DOUBLE,
+   PREC_KAHAN (compensated summation), PREC_LONG or PREC_QUAD. The long
+   double and __float128 routines hypernl and hypernq can also be called
+   directly, as can the series sums hypersumnl, hypersumrl, hypersumnq and
+   hypersumrq.
+
+	#define HYPER_OK 0
+	#define HYPER_NOCONV 1
+	#define HYPER_DOMAIN 2
+	#define HYPER_POLE 3
+	#define HYPER_INEXACT 4
+
+	extern int hyperr(double a, double b, double c, double x,
+		double derror, long maxterms, double *f, double *err,
+		long *terms);
+
+   hyper and its relatives may loop forever on bad parameters. hyperr
+   checks its parameters, stops after maxterms series terms (if maxterms
+   > 0), and returns one of the status codes above along with the value,
+   an error estimate and the number of terms summed. See the comment
+   above its definition for details. None of these routines keep static
+   data, so they may be called from several threads at once.
+
+   Compile this file with cc -c -DNO_MAIN and link your program with hyper.o,
+   or use the libhyper.a library target of Makefile.am, which does that and
+   installs hyper.h. Include hyper.h for the declarations above.
 
    Bugs:
 		- We only support real number computations.
@@ -89,11 +140,19 @@
 #include<string.h>
 #include<float.h>
 #include<math.h>
-
-#define VERSION "1.1"
+#include<time.h>
+#include<stdarg.h>
+#include<pthread.h>
+#ifdef QUAD
+#include<quadmath.h>
+#endif
+#include "hyper.h"
+
+#define VERSION "1.3"
 #define PROGRAMNAME "Hyper"
 
-#define USAGE "hyper [-hvi -p <n> -a|b|c|x <n> -dx|a|b|c -n <n> -xml ]"   
+#define USAGE "hyper [-hvi -p <n> -a|b|c|x <n> -dx|a|b|c -n <n> -xml|csv|bin\n\
+	-terms -prec double|kahan|long|quad -bench -check -j <n> -f <file> ]"   
 
 #define HELP "\n"USAGE"\n\n\
 -h:   print this helpful message.\n\
@@ -109,7 +168,20 @@
 -db:  specify increment in b (default = 0.0.)\n\
 -dc:  specify increment in c (default = 0.0.)\n\
 -n:   specify number of times to increment, i.e. rows - 1 (default = 0.)\n\
--xml: generate xml output for function_table stylesheet.\n\n\
+-xml: generate xml output for function_table stylesheet.\n\
+-csv: generate comma separated values, with full precision.\n\
+-bin: generate binary output (see the source for the format.)\n\
+-j:   evaluate and format the table using n threads (default 1.)\n\
+-f:   batch mode: tabulate F at the points (a, b, c, x) listed one per line\n\
+      in file (- for standard input) instead of a grid.\n\
+-terms: add a column giving the number of series terms summed.\n\
+-prec: sum in double (default), double with compensated (Kahan) summation,\n\
+       long double, or __float128 (only if compiled with -DQUAD.)\n\
+-bench: instead of the table, time its evaluation in each precision, at\n\
+       tolerances from -p down to what the precision can attain, and show\n\
+       the largest error reached against the most precise one.\n\
+-check: compare F in each precision with known values at points where it\n\
+       is hard to compute, and print the number of disagreements.\n\n\
 Tabulate the hypergeometric function F(a,b,c;x).\n\n"
 
 #define PROMPT ": "
@@ -136,24 +208,83 @@ union my_data {
 	char *s;
 };
 
-/* Forward declarations: all are implemented in this file. */
+/* Forward declarations: all are implemented in this file. The public
+ * routines, and the PREC_ and HYPER_ constants, are in hyper.h. */
 
 int getuser(union my_data *data, int type, char *message);
-double hypersum(double a, double b, double c, double x, double derror);
-double hyper(double a, double b, double c, double x, double derror);
+void hyperbench(int n, double a, double b, double c, double x, double da,
+		double db, double dc, double dx, double derror);
+int hypercheck(void);
 int handle_error(void);
 
+/* hyperbench repeats its work until at least this many seconds pass */
+
+#define BENCH_TIME 0.25
+
 #define DERROR .0000001
 
+/* Number of series hypergrid sums in lockstep. 8 doubles fill an AVX-512
+ * register, or two AVX2 registers. Table rows are evaluated in blocks of
+ * GRID_BLOCK. */
+
+#define HYPER_LANES 8
+#define GRID_BLOCK 1024
+
 
 #ifndef NO_MAIN
+
+/* Table output formats */
+
+#define FMT_TEXT 0
+#define FMT_XML 1
+#define FMT_CSV 2
+#define FMT_BIN 3
+
+#define ROW_MAX 256		/* usual longest formatted row */
+#define OUTBUF (1<<20)		/* size of the stdout buffer */
+#define MAX_THREADS 64
+
+/* What to tabulate. For a grid, the a, b, c and x fields hold the values
+ * for the next row to be generated, and n the number of rows still to go.
+ * In batch mode the rows are read from in instead; line counts the lines
+ * read, for error messages. */
+
+struct tablespec {
+	int n, prec, format, showterms;
+	double derror;
+	double a, b, c, x, da, db, dc, dx;
+	FILE *in;
+	long line;
+};
+
+/* A block of rows, and its formatted output: len bytes in out, which has
+ * room for cap. out starts with room for GRID_BLOCK rows of ROW_MAX, and
+ * grows if huge values make the rows longer. */
+
+struct tableblock {
+	int m, done;
+	double a[GRID_BLOCK],b[GRID_BLOCK],c[GRID_BLOCK],x[GRID_BLOCK];
+	double f[GRID_BLOCK];
+	int t[GRID_BLOCK];
+	char *out;
+	size_t len, cap;
+};
+
+static void tableheader(struct tablespec *s);
+static void tablefooter(struct tablespec *s);
+static int tablewrite(struct tablespec *s, int threads);
+
 int
 main(int argc, char **argv)
 {
 	int n = 1,i=1;
-	int xml=0;
+	int format=FMT_TEXT,showterms=0,bench=0,threads=1;
+	int prec = PREC_DOUBLE;
+	double eps;
 	double a = 1.0, b = 1.0, c=1.0, x = 0.0, dx = 0.1, derror = DERROR;
 	double da = 0.0, db = 0.0, dc = 0.0,t;
+	struct tablespec spec;
+	char *batch = NULL;
 	int interactive = 0;
 	union my_data user_data;
 
@@ -171,13 +302,72 @@ main(int argc, char **argv)
 		  }
 		  if(strcmp(argv[i],"-a")==0){
 			a = atof(argv[i+1]);
-			if(derror <= DBL_EPSILON)
-			        fprintf(stderr,"Warning: requested precision may exceed implementation limit.\n");
 			i += 2;
 			continue;
 		  }
 		  if(strcmp(argv[i],"-xml")==0){
-			  xml = 1;
+			  format = FMT_XML;
+			  i += 1;
+			  continue;
+		  }
+		  if(strcmp(argv[i],"-csv")==0){
+			  format = FMT_CSV;
+			  i += 1;
+			  continue;
+		  }
+		  if(strcmp(argv[i],"-bin")==0){
+			  format = FMT_BIN;
+			  i += 1;
+			  continue;
+		  }
+		  if(strcmp(argv[i],"-f")==0){
+			batch = argv[i+1];
+			i += 2;
+			continue;
+		  }
+		  if(strcmp(argv[i],"-j")==0){
+			threads = atoi(argv[i+1]);
+			if(threads < 1 || threads > MAX_THREADS){
+				fprintf(stderr,"hyper: number of threads must be in the range 1-%d\n",
+						MAX_THREADS);
+				return 1;
+			}
+			i += 2;
+			continue;
+		  }
+		  if(strcmp(argv[i],"-prec")==0){
+			if(i+1 >= argc)prec = -1;
+			else if(strcmp(argv[i+1],"double")==0)
+				prec = PREC_DOUBLE;
+			else if(strcmp(argv[i+1],"kahan")==0)
+				prec = PREC_KAHAN;
+			else if(strcmp(argv[i+1],"long")==0)
+				prec = PREC_LONG;
+#ifdef QUAD
+			else if(strcmp(argv[i+1],"quad")==0)
+				prec = PREC_QUAD;
+#endif
+			else prec = -1;
+			if(prec < 0){
+				fprintf(stderr,"hyper: unknown or unsupported precision %s\n",
+					i+1 < argc ? argv[i+1] : "");
+				return 1;
+			}
+			i += 2;
+			continue;
+		  }
+		  if(strcmp(argv[i],"-bench")==0){
+			  bench = 1;
+			  i += 1;
+			  continue;
+		  }
+		  if(strcmp(argv[i],"-check")==0){
+			i = hypercheck();
+			printf("%d failures\n",i);
+			return i ? 1 : 0;
+		  }
+		  if(strcmp(argv[i],"-terms")==0){
+			  showterms = 1;
 			  i += 1;
 			  continue;
 		  }
@@ -273,124 +463,1103 @@ main(int argc, char **argv)
 	/* do sanity checks here. Warn the user when there is a problem
 	 * but blunder onward anyway. */
 
-	if(x + dx*(double)n >= 1.0)
-		fprintf(stderr,"Warning: x range includes values 1.0 or larger. F is singular there.\n\n" );
+	switch(prec){
+		case PREC_LONG:
+			eps = LDBL_EPSILON;
+			break;
+#ifdef QUAD
+		case PREC_QUAD:
+			eps = FLT128_EPSILON;
+			break;
+#endif
+		default:
+			eps = DBL_EPSILON;
+	}
+	if(derror <= eps && !bench)
+		fprintf(stderr,"Warning: requested precision may exceed implementation limit.\n");
+
+	if(!batch && x + dx*(double)n >= 1.0)
+		fprintf(stderr,"Warning: x range includes values 1.0 or larger. F is singular at 1\n\
+and has a branch cut beyond, where the real part is shown.\n\n" );
 
 	i=0,t=c;
-	while(i++<n){
+	while(!batch && i++<n){
 		if((t <= 0.0)&&((-t)-floor(-t)==0))
 		fprintf(stderr,"Warning: c parameter can be 0 or negative integer.\n\n");
 		t += dc;
 	}
 
-	if(xml){
+	if(n < 1)n = 1;
+	if(bench){
+		hyperbench(n,a,b,c,x,da,db,dc,dx,derror);
+		return 0;
+	}
+
+	spec.n = n;
+	spec.prec = prec;
+	spec.format = format;
+	spec.showterms = showterms;
+	spec.derror = derror;
+	spec.a = a;
+	spec.b = b;
+	spec.c = c;
+	spec.x = x;
+	spec.da = da;
+	spec.db = db;
+	spec.dc = dc;
+	spec.dx = dx;
+	spec.in = NULL;
+	spec.line = 0;
+	if(batch){
+		if(strcmp(batch,"-") == 0)spec.in = stdin;
+		else if(!(spec.in = fopen(batch,"r"))){
+			fprintf(stderr,"hyper: cannot open %s\n",batch);
+			return 1;
+		}
+	}
+	setvbuf(stdout,NULL,_IOFBF,OUTBUF);
+	tableheader(&spec);
+	if(tablewrite(&spec,threads)){
+		fprintf(stderr,"hyper: cannot start threads or allocate memory.\n");
+		return 1;
+	}
+	tablefooter(&spec);
+	return 0;
+}
+
+/* Table output.
+ *
+ * The rows are generated GRID_BLOCK at a time. For each block, tablefill
+ * steps the parameters along, in the same order and with the same
+ * rounding as a row-by-row loop would, or reads them from the batch
+ * input, and tablerows evaluates the block
+ * and formats it into the block's own output buffer. With -j, tablerows
+ * runs in a pool of worker threads, while the main thread fills blocks
+ * ahead and writes finished ones in order. The output is therefore the
+ * same for any number of threads. Output goes through a large stdio
+ * buffer, one fwrite per block.
+ *
+ * The binary format is the 8 bytes HYPRTAB1, an int giving the number
+ * of columns (5, or 6 with -terms), then for each row the columns x, a, b,
+ * c, F(a,b,c;x) and the term count as doubles, all in native byte order.
+ */
+
+static void tableheader(struct tablespec *s)
+{
+	int ncols = s->showterms ? 6 : 5;
+
+	switch(s->format){
+	case FMT_XML:
 		printf(XML_HEADER);
 		printf("<header>\n\
 	<cell width=\"5\">x</cell>\n\
 	<cell width=\"5\">a</cell>\n\
 	<cell width=\"5\">b</cell>\n\
 	<cell width=\"5\">c</cell>\n\
-	<cell width=\"11\">F(a,b,c;x)</cell>\n\
-</header> \n");
-	}
-	else {
+	<cell width=\"11\">F(a,b,c;x)</cell>\n");
+		if(s->showterms)
+			printf("	<cell width=\"5\">terms</cell>\n");
+		printf("</header> \n");
+		break;
+	case FMT_CSV:
+		printf("x,a,b,c,F%s\n",s->showterms ? ",terms" : "");
+		break;
+	case FMT_BIN:
+		fwrite("HYPRTAB1",1,8,stdout);
+		fwrite(&ncols,sizeof(int),1,stdout);
+		break;
+	default:
 		printf("               The Hypergeometric Function\n\n");
-		printf("     x        a        b        c             F(a,b,c;x)  \n",
-			a,b,c);
-		printf("--------------------------------------------------------\n");
+		printf("     x        a        b        c             F(a,b,c;x)  %s\n",
+			s->showterms ? "   terms" : "");
+		printf("--------------------------------------------------------%s\n",
+			s->showterms ? "--------" : "");
 
 	}
-	i = 1;
-	do {
-		if(xml){
-			printf("<row>\n\
+}
+
+static void tablefooter(struct tablespec *s)
+{
+	if(s->format == FMT_XML)printf(XML_FOOTER);
+}
+
+/* Read the next (a, b, c, x) tuple of a batch into row m of blk. The
+ * numbers are separated by white space or commas. Blank lines and lines
+ * starting with # are skipped; other lines which do not hold exactly 4
+ * numbers, or are longer than MAXLINE, are reported and skipped. Returns
+ * 1 if a tuple was read, 0 at end of input. */
+
+static int tableread(struct tablespec *s, struct tableblock *blk, int m)
+{
+	char buffer[MAXLINE],*p;
+	int c,n;
+
+	while(fgets(buffer,MAXLINE,s->in)){
+		s->line++;
+		if(strchr(buffer,'\n') == NULL && !feof(s->in)){
+			while((c = getc(s->in)) != EOF && c != '\n')
+				;
+			fprintf(stderr,"hyper: line %ld: longer than %d characters, skipped.\n",
+					s->line,MAXLINE-2);
+			continue;
+		}
+		for(p=buffer;*p;p++)
+			if(*p == ',')*p = ' ';
+		p = buffer + strspn(buffer," \t\r\n");
+		if(*p == '\0' || *p == '#')continue;
+		n = 0;
+		if(sscanf(p,"%lf %lf %lf %lf %n",blk->a+m,blk->b+m,blk->c+m,
+					blk->x+m,&n) == 4 && p[n] == '\0')
+			return 1;
+		fprintf(stderr,"hyper: line %ld: expected a b c x, skipped.\n",
+				s->line);
+	}
+	return 0;
+}
+
+/* Load the parameters of the next rows (at most GRID_BLOCK of the
+ * remaining ones) into blk. Returns the number of rows loaded, 0 when
+ * there are no more. */
+
+static int tablefill(struct tablespec *s, struct tableblock *blk)
+{
+	int m;
+
+	if(s->in){
+		for(m=0;m<GRID_BLOCK && tableread(s,blk,m);m++)
+			;
+		return blk->m = m;
+	}
+	for(m=0;m<GRID_BLOCK && s->n > 0;m++,s->n--){
+		blk->x[m] = s->x;
+		blk->a[m] = s->a;
+		blk->b[m] = s->b;
+		blk->c[m] = s->c;
+		s->x += s->dx;
+		s->a += s->da;
+		s->b += s->db;
+		s->c += s->dc;
+	}
+	return blk->m = m;
+}
+
+/* Make room for n more bytes in blk->out */
+
+static void blkroom(struct tableblock *blk, size_t n)
+{
+	if(blk->len + n <= blk->cap)return;
+	while(blk->len + n > blk->cap)
+		blk->cap = blk->cap ? 2*blk->cap : GRID_BLOCK*ROW_MAX;
+	if(!(blk->out = (char *)realloc(blk->out,blk->cap))){
+		fprintf(stderr,"hyper: memory allocation failed.\n");
+		exit(1);
+	}
+}
+
+/* printf to the end of blk->out, growing it if need be */
+
+static void blkprintf(struct tableblock *blk, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	blkroom(blk,ROW_MAX);
+	va_start(ap,fmt);
+	n = vsnprintf(blk->out + blk->len,blk->cap - blk->len,fmt,ap);
+	va_end(ap);
+	if(n >= 0 && (size_t)n >= blk->cap - blk->len){
+		blkroom(blk,n+1);
+		va_start(ap,fmt);
+		vsnprintf(blk->out + blk->len,blk->cap - blk->len,fmt,ap);
+		va_end(ap);
+	}
+	if(n > 0)blk->len += n;
+}
+
+/* Evaluate the rows of blk, with hypergrid in double precision and row by
+ * row in the others, and format them into blk->out. */
+
+static void tablerows(struct tablespec *s, struct tableblock *blk)
+{
+	double rec[6];
+	int j;
+
+	if(s->prec == PREC_DOUBLE)
+		hypergrid(blk->m,blk->a,blk->b,blk->c,blk->x,s->derror,blk->f,
+				blk->t);
+	else for(j=0;j<blk->m;j++)
+		blk->f[j] = hyperp(blk->a[j],blk->b[j],blk->c[j],blk->x[j],
+				s->derror,s->prec,blk->t+j);
+
+	blk->len = 0;
+	for(j=0;j<blk->m;j++){
+		switch(s->format){
+		case FMT_XML:
+			blkprintf(blk,"<row>\n\
 	<cell width=\"5\">%.3f</cell>\n\
 	<cell width=\"5\">%.3f</cell>\n\
 	<cell width=\"5\">%.3f</cell>\n\
 	<cell width=\"5\">%.3f</cell>\n\
-	<cell width=\"11\">%.7f</cell>\n\
-</row>\n",x,a,b,c,hyper(a,b,c,x,derror));
+	<cell width=\"11\">%.7f</cell>\n",blk->x[j],blk->a[j],blk->b[j],
+				blk->c[j],blk->f[j]);
+			if(s->showterms)
+				blkprintf(blk,"	<cell width=\"5\">%d</cell>\n",
+						blk->t[j]);
+			blkprintf(blk,"</row>\n");
+			break;
+		case FMT_CSV:
+			blkprintf(blk,"%.17g,%.17g,%.17g,%.17g,%.17g",
+				blk->x[j],blk->a[j],blk->b[j],blk->c[j],
+				blk->f[j]);
+			if(s->showterms)
+				blkprintf(blk,",%d",blk->t[j]);
+			blkprintf(blk,"\n");
+			break;
+		case FMT_BIN:
+			rec[0] = blk->x[j];
+			rec[1] = blk->a[j];
+			rec[2] = blk->b[j];
+			rec[3] = blk->c[j];
+			rec[4] = blk->f[j];
+			rec[5] = blk->t[j];
+			blkroom(blk,sizeof(rec));
+			memcpy(blk->out + blk->len,rec,
+				(s->showterms ? 6 : 5)*sizeof(double));
+			blk->len += (s->showterms ? 6 : 5)*sizeof(double);
+			break;
+		default:
+			if(s->showterms)
+			       blkprintf(blk,"%8.3f %8.3f %8.3f %8.3f %20.8f %8d\n",
+				       blk->x[j],blk->a[j],blk->b[j],blk->c[j],
+				       blk->f[j],blk->t[j]);
+			else
+			       blkprintf(blk,"%8.3f %8.3f %8.3f %8.3f %20.8f\n",
+				       blk->x[j],blk->a[j],blk->b[j],blk->c[j],
+				       blk->f[j]);
+		}
+	}
+}
+
+/* The worker pool. Blocks are numbered in output order; filled counts
+ * the blocks the main thread has loaded, taken those claimed by workers.
+ * Block k lives in slot k % nslot. */
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;	/* a block was filled, or quit was set */
+	pthread_cond_t done;	/* a block was finished */
+	struct tableblock *slot;
+	int nslot;
+	int filled, taken;
+	int quit;
+	struct tablespec *spec;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0, 0, NULL};
+
+static void *tableworker(void *arg)
+{
+	struct tableblock *blk;
+
+	(void)arg;
+	pthread_mutex_lock(&pool.lock);
+	while(1){
+		while(pool.taken == pool.filled && !pool.quit)
+			pthread_cond_wait(&pool.ready,&pool.lock);
+		if(pool.taken == pool.filled)break;
+		blk = pool.slot + pool.taken++ % pool.nslot;
+		pthread_mutex_unlock(&pool.lock);
+
+		tablerows(pool.spec,blk);
+
+		pthread_mutex_lock(&pool.lock);
+		blk->done = 1;
+		pthread_cond_signal(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+/* Generate and write all the rows of the table, using the given number of
+ * threads. Returns 0 on success, 1 if memory or threads are not
+ * available. */
+
+static int tablewrite(struct tablespec *s, int threads)
+{
+	pthread_t tid[MAX_THREADS];
+	struct tableblock *blk;
+	int k,w,more = 1;
+
+	if(threads <= 1){
+		if(!(blk = (struct tableblock *)calloc(1,sizeof(*blk))))
+			return 1;
+		while(tablefill(s,blk)){
+			tablerows(s,blk);
+			fwrite(blk->out,1,blk->len,stdout);
+		}
+		free(blk->out);
+		free(blk);
+		return 0;
+	}
+
+	/* Two slots per thread let the workers run ahead of the writer */
+
+	pool.nslot = 2*threads;
+	pool.slot = (struct tableblock *)calloc(pool.nslot,sizeof(*blk));
+	if(!pool.slot)return 1;
+	pool.filled = pool.taken = pool.quit = 0;
+	pool.spec = s;
+	for(k=0;k<threads;k++)
+		if(pthread_create(tid+k,NULL,tableworker,NULL))
+			return 1;
+
+	/* Only this thread changes pool.filled, so it can read it without
+	 * the lock. A block is filled outside the lock, since reading it
+	 * from a batch may block, and then published. */
+
+	for(w=0;;w++){
+		while(more && pool.filled - w < pool.nslot){
+			blk = pool.slot + pool.filled % pool.nslot;
+			blk->done = 0;
+			if(!(more = tablefill(s,blk)))
+				break;
+			pthread_mutex_lock(&pool.lock);
+			pool.filled++;
+			pthread_cond_signal(&pool.ready);
+			pthread_mutex_unlock(&pool.lock);
 		}
-		else
-		       printf("%8.3f %8.3f %8.3f %8.3f %20.8f\n",x,a,b,c,hyper(a,b,c,x,derror));
-		x += dx;
-		a += da;
-		b += db;
-		c += dc;
-	} while(i++ < n);
-	
-	if(xml)printf(XML_FOOTER);
+		if(w == pool.filled)break;
+		blk = pool.slot + w % pool.nslot;
+		pthread_mutex_lock(&pool.lock);
+		while(!blk->done)
+			pthread_cond_wait(&pool.done,&pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+		fwrite(blk->out,1,blk->len,stdout);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = 1;
+	pthread_cond_broadcast(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+	for(k=0;k<threads;k++)
+		pthread_join(tid[k],NULL);
+	for(k=0;k<pool.nslot;k++)
+		free(pool.slot[k].out);
+	free(pool.slot);
 	return 0;
 }
+
+/* hyperbench: evaluate the n table rows in each precision, at a sweep of
+ * error tolerances, and print for each the time per evaluation, the terms
+ * summed and the largest error actually reached against a reference. The
+ * sweep starts at derror and divides it by BENCH_STEP until it reaches the
+ * tolerance each precision can attain, a few of its epsilons, which is
+ * the last row. The reference is computed in the most precise arithmetic
+ * available with derror at its epsilon, so its own error is beyond what
+ * the table can show. Each row repeats its work until BENCH_TIME has
+ * passed. */
+
+#ifdef QUAD
+typedef __float128 benchreal;
+#define BENCH_EPS FLT128_EPSILON
+#define BENCH_FABS fabsq
+#else
+typedef long double benchreal;
+#define BENCH_EPS LDBL_EPSILON
+#define BENCH_FABS fabsl
+#endif
+
+#define BENCH_STEP 1e4
+
+/* One evaluation in precision k to within tol */
+
+static benchreal hyperbench1(int k, double a, double b, double c, double x,
+		benchreal tol, int *terms)
+{
+	switch(k){
+#ifdef QUAD
+		case PREC_QUAD:
+			return hypernq(a,b,c,x,tol,terms);
+#endif
+		case PREC_LONG:
+			return hypernl(a,b,c,x,(long double)tol,terms);
+		default:
+			return hyperp(a,b,c,x,(double)tol,k,terms);
+	}
+}
+
+void hyperbench(int n, double a, double b, double c, double x, double da,
+		double db, double dc, double dx, double derror)
+{
+	static char *names[] = {"double","kahan","long double","__float128"};
+	benchreal floors[] = {8*DBL_EPSILON,8*DBL_EPSILON,8*LDBL_EPSILON,
+		8*BENCH_EPS};
+	double *pa,*pb,*pc,*px;
+	benchreal *ref,f,d,err,tol;
+	double secs;
+	clock_t start;
+	long reps;
+	int i,k,nprec,t,last;
+
+	pa = (double *)malloc(n*sizeof(double));
+	pb = (double *)malloc(n*sizeof(double));
+	pc = (double *)malloc(n*sizeof(double));
+	px = (double *)malloc(n*sizeof(double));
+	ref = (benchreal *)malloc(n*sizeof(benchreal));
+	if(!(pa && pb && pc && px && ref)){
+		fprintf(stderr,"hyper: memory allocation failed.\n");
+		exit(1);
+	}
+	for(i=0;i<n;i++){
+		pa[i] = a + i*da;
+		pb[i] = b + i*db;
+		pc[i] = c + i*dc;
+		px[i] = x + i*dx;
+	}
+
+#ifdef QUAD
+	nprec = 4;
+#else
+	nprec = 3;
+#endif
+	for(i=0;i<n;i++)
+		ref[i] = hyperbench1(nprec-1,pa[i],pb[i],pc[i],px[i],BENCH_EPS,
+				NULL);
+
+	printf("        Hypergeometric Function Benchmark, %d points\n\n",n);
+	printf("  precision    tolerance   time per evaluation (us)    terms    max error\n");
+	printf("--------------------------------------------------------------------------\n");
+	for(k=0;k<nprec;k++){
+		tol = derror;
+		do {
+			last = tol <= floors[k];
+			if(last)
+				tol = floors[k];
+			reps = 0;
+			start = clock();
+			do {
+				for(i=0;i<n;i++)
+					hyperbench1(k,pa[i],pb[i],pc[i],px[i],tol,&t);
+				reps++;
+				secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+			} while(secs < BENCH_TIME);
+
+			/* One more pass to total the terms and measure errors */
+
+			err = 0;
+			for(i=0,t=0;i<n;i++){
+				int nt;
+
+				f = hyperbench1(k,pa[i],pb[i],pc[i],px[i],tol,&nt);
+				t += nt;
+				d = f == ref[i] ? 0 : BENCH_FABS(f - ref[i]);
+				if(d > err || d != d)err = d;
+			}
+			printf("%-12s %11.1Le %18.3f %18d %12.3Le\n",names[k],
+					(long double)tol,
+					1e6*secs/((double)reps*n),t,(long double)err);
+			tol /= BENCH_STEP;
+		} while(!last);
+	}
+	free(pa);
+	free(pb);
+	free(pc);
+	free(px);
+	free(ref);
+}
+
+/* hypercheck: evaluate F in each precision at points where it has gone
+ * wrong before, and compare with reference values. Returns the number of
+ * disagreements, which are printed. The references were computed in
+ * __float128 with tolerance 1e-28, or are known in closed form. The
+ * second to fourth points have c-a-b within rounding of 0 (the second is
+ * c = 0.7 + 0.1 + 0.1 + 0.1 + 0.1 from a table), and the last
+ * a-b within 1e-12 of -1, where the transformations have poles. hyperr
+ * must also bound its error there. */
+
+static struct {
+	double a, b, c, x, f;
+} hypercases[] = {
+	{1, 1, 2, 0.9, 2.558427881104496},	/* -log(1-x)/x */
+	{0.3, 0.8, 1.0999999999999999, 0.9, 1.5549251181398145},
+	{0.3, 0.8, 1.100000000000001, 0.9, 1.5549251181398136},
+	{0.3, 0.8, 1.10000000001, 0.9, 1.5549251181306178},
+	{0.5, 1.500000000001, 3, -3, 0.65727411065964647},
+};
+
+int hypercheck(void)
+{
+	static char *names[] = {"double","kahan","long double","__float128"};
+	benchreal f;
+	double fr,err;
+	long nt;
+	int i,k,nprec,t,bad = 0;
+
+#ifdef QUAD
+	nprec = 4;
+#else
+	nprec = 3;
+#endif
+	for(i=0;i<(int)(sizeof(hypercases)/sizeof(hypercases[0]));i++)
+		for(k=0;k<nprec;k++){
+			f = hyperbench1(k,hypercases[i].a,hypercases[i].b,
+				hypercases[i].c,hypercases[i].x,DERROR,&t);
+			if(!(BENCH_FABS(f - hypercases[i].f) < DERROR)){
+				fprintf(stderr,"hyper: F(%.17g,%.17g,%.17g;%g) is %.17Lg in %s, should be %.17g\n",
+					hypercases[i].a,hypercases[i].b,
+					hypercases[i].c,hypercases[i].x,
+					(long double)f,names[k],hypercases[i].f);
+				bad++;
+			}
+		}
+	for(i=0;i<(int)(sizeof(hypercases)/sizeof(hypercases[0]));i++)
+		if(hyperr(hypercases[i].a,hypercases[i].b,hypercases[i].c,
+				hypercases[i].x,DERROR,0,&fr,&err,&nt) != HYPER_OK ||
+				!(fabs(fr - hypercases[i].f) <= err)){
+			fprintf(stderr,"hyper: hyperr gives F(%.17g,%.17g,%.17g;%g) = %.17g +- %g, should be %.17g\n",
+				hypercases[i].a,hypercases[i].b,hypercases[i].c,
+				hypercases[i].x,fr,err,hypercases[i].f);
+			bad++;
+		}
+	return bad;
+}
 #endif /* NO_MAIN */
 
 
+/* Argument reduction.
+ *
+ * Each of the linear transformations described in the header writes F(x)
+ * as a combination of at most two hypergeometric series in a new variable
+ * lying in [0,1/2], where the series converge at least as fast as a
+ * geometric series of ratio 1/2. A struct hyperplan records such a
+ * combination, F = coef[0]*F0 + coef[1]*F1, where Fk is the series with
+ * parameters a[k], b[k], c[k] and variable x[k]. hyperreduce chooses the
+ * transformation for a given point; hyper and hypergrid then sum the
+ * series and combine them.
+ */
+
+#define HAVE_INV 1
+#define HAVE_REFL 2
+
+/* The gamma function coefficients depend only on (a,b,c), so callers
+ * evaluating F at many x for the same parameters can compute them once.
+ * A struct hypercoef holds them, each pair computed when first needed:
+ *
+ *	inv[0] = G(c)G(b-a)/(G(b)G(c-a)),  inv[1] = G(c)G(a-b)/(G(a)G(c-b))
+ *	refl[0] = G(c)G(s)/(G(c-a)G(c-b)), refl[1] = G(c)G(-s)/(G(a)G(b))
+ *
+ * where G is the gamma function and s = c-a-b. The inv pair serves both
+ * the 1/x and 1/(1-x) transformations, the refl pair the 1-x one, and
+ * refl[0] is also F(1). */
+
+/* Choose the transformation for F(a,b,c;x). The cases are
+ *
+ *	a or b = 0,-1,-2,...:	F is a polynomial. Sum it as it stands.
+ *	0 <= x <= 1/2:		Sum.
+ *	-1 <= x < 0:		x -> x/(x-1).
+ *	x < -1:			x -> 1/(1-x).
+ *	1/2 < x < 1:		x -> 1-x.
+ *	x = 1:			Gauss' theorem.
+ *	1 < x <= 2:		x -> 1-x, then x -> x/(x-1).
+ *	x > 2:			x -> 1/x.
+ *
+ * The formulas for 1-x, 1/x and 1/(1-x) (see, e.g., Abramowitz and Stegun,
+ * Handbook of Mathematical Functions, 15.3.6-15.3.8) have gamma function
+ * coefficients with poles when c-a-b, resp. a-b, is an integer. (The
+ * correct formulas then involve logarithms.) Near such a pole the two
+ * terms are huge and cancel, losing about as many digits as the distance
+ * to the integer has leading zeros, so we treat c-a-b or a-b within
+ * sqrt(epsilon) (relative) of an integer as degenerate: the error of the
+ * combination is then at most about sqrt(epsilon). In those cases we fall
+ * back to the slowly converging sums of version 1.1 for x < 1.
+ *
+ * For x > 1 the real axis is a branch cut, and the limits of F from above
+ * and below are complex conjugates. We return their common real part.
+ * That is NaN if the formula for the case above is degenerate, and F(1) is
+ * HUGE_VAL if c-a-b <= 0.
+ */
+
+/* hypersumr: sum the series for F(a,b,c;x) into *f, stopping when the
+ * tail is < derror or, if maxterms > 0, after maxterms terms. The number
+ * of terms summed is stored in *terms and, if err is not NULL, a bound for
+ * the tail in *err. The bound is HUGE_VAL if the series was cut off before
+ * the test below applies. Returns HYPER_OK, or HYPER_NOCONV if the budget
+ * ran out. */
+
+/* The test in hypersumr for stopping: let An be nth term of the series,
+ * and Bn = (a+n)(b+n)/[(c+n)(1+n)]. Then An+1/An = Bnx. Bn --> 1, which
+ * gives radius of convergence 1. Let Cn be a monotone nonincreasing upper
+ * bound for |Bn|. Then by comparison with geometric series, |An|/(1-Cnx) <
+ * derror is sufficient to ensure accuracy. If we let K be the max of
+ * |a|,|b|,|c|, then it is easy to check that Cn = 1 + 6K/n + 2(K/n)^2 is
+ * such a monotone upper bound when n > 2K. If a term is 0, so are all the
+ * following ones. */
+
+/* The routines above, from reduction to summation, are needed in every
+ * precision. HYPER_CORE(T,S,...) defines them for the floating type T,
+ * with the math library functions for T passed as arguments, and suffix S
+ * on every name. It is instantiated for double (no suffix), long double
+ * (suffix l, as in the C library) and, when compiled with -DQUAD and
+ * linked with -lquadmath, GCC's __float128 (suffix q, as in libquadmath),
+ * so all precisions share this one copy of the code. The double-only
+ * routines that follow (hyperplansum, hyperr, hypersumk, hypergrid and
+ * hyperp) build on the double instance.
+ *
+ * In it:
+ *
+ * struct hyperplan holds a reduced F as described above, and struct
+ * hypercoef the coefficients of the reductions for one (a,b,c).
+ *
+ * rgamma is 1/Gamma(x), which is 0 at the poles x = 0, -1, -2, ...
+ *
+ * isint tests whether x is an integer, and nearint whether it is within
+ * sqrt(epsilon) of one, relative to |x| when that is above 1.
+ *
+ * hyperpush adds a series to a plan, using the Pfaff transformation to
+ * move a variable in [-1,0) into (0,1/2].
+ *
+ * hyperinv and hyperrefl compute the coefficients (see below) when first
+ * needed, and hyperreducek reduces x for the parameters in a struct
+ * hypercoef, so that callers evaluating F at many x for the same
+ * parameters compute the coefficients once. hyperreduce does the same for
+ * one point.
+ *
+ * hyperderror gives the error allowed in the k-th series of a plan, so
+ * that the combination is accurate to within derror. A series with
+ * coefficient 0 or NaN need not be summed at all, which is signalled by
+ * returning 0.
+ *
+ * hypersumr sums one series (see the comment before it below), and
+ * hypersumn and hypern are described with hyper and hypersum.
+ */
+
+#define HYPER_CORE(T,S,FABS,FLOOR,FMAX,POW,COS,TGAMMA,SQRT,PI,EPS)	\
+									\
+struct hyperplan##S {							\
+	int n;								\
+	T coef[2];							\
+	T a[2],b[2],c[2],x[2];						\
+};									\
+									\
+static T rgamma##S(T x)							\
+{									\
+	if((x <= 0) && (x == FLOOR(x)))return 0;			\
+	return 1/TGAMMA(x);						\
+}									\
+									\
+static int isint##S(T x)						\
+{									\
+	return x == FLOOR(x);						\
+}									\
+									\
+static int nearint##S(T x)						\
+{									\
+	return FABS(x - FLOOR(x + (T)0.5)) <= SQRT(EPS)*FMAX(1,FABS(x));	\
+}									\
+									\
+static void hyperpush##S(struct hyperplan##S *p, T coef, T a, T b,	\
+		T c, T x)						\
+{									\
+	if(x < 0){							\
+		coef *= POW(1-x,-a);					\
+		b = c - b;						\
+		x = x/(x-1);						\
+	}								\
+	p->coef[p->n] = coef;						\
+	p->a[p->n] = a;							\
+	p->b[p->n] = b;							\
+	p->c[p->n] = c;							\
+	p->x[p->n] = x;							\
+	p->n++;								\
+}									\
+									\
+struct hypercoef##S {							\
+	T a,b,c;							\
+	int have;							\
+	T inv[2],refl[2];						\
+};									\
+									\
+static void hypercoefinit##S(struct hypercoef##S *k, T a, T b, T c)	\
+{									\
+	k->a = a;							\
+	k->b = b;							\
+	k->c = c;							\
+	k->have = 0;							\
+}									\
+									\
+static T *hyperinv##S(struct hypercoef##S *k)				\
+{									\
+	T a = k->a, b = k->b, c = k->c;					\
+									\
+	if(!(k->have & HAVE_INV)){					\
+		k->inv[0] = TGAMMA(c)*TGAMMA(b-a)*rgamma##S(b)*rgamma##S(c-a);	\
+		k->inv[1] = TGAMMA(c)*TGAMMA(a-b)*rgamma##S(a)*rgamma##S(c-b);	\
+		k->have |= HAVE_INV;					\
+	}								\
+	return k->inv;							\
+}									\
+									\
+static T *hyperrefl##S(struct hypercoef##S *k)				\
+{									\
+	T a = k->a, b = k->b, c = k->c, s = c - a - b;			\
+									\
+	if(!(k->have & HAVE_REFL)){					\
+		k->refl[0] = TGAMMA(c)*TGAMMA(s)*rgamma##S(c-a)*rgamma##S(c-b);	\
+		k->refl[1] = TGAMMA(c)*TGAMMA(-s)*rgamma##S(a)*rgamma##S(b);	\
+		k->have |= HAVE_REFL;					\
+	}								\
+	return k->refl;							\
+}									\
+									\
+static void hyperreducek##S(struct hypercoef##S *k, T x,		\
+		struct hyperplan##S *p)					\
+{									\
+	T a = k->a, b = k->b, c = k->c;					\
+	T s = c - a - b, *g;						\
+									\
+	p->n = 0;							\
+	if((a <= 0 && isint##S(a)) || (b <= 0 && isint##S(b)) ||	\
+			((x >= 0) && (x <= 0.5))){			\
+		p->coef[0] = 1;						\
+		p->a[0] = a;						\
+		p->b[0] = b;						\
+		p->c[0] = c;						\
+		p->x[0] = x;						\
+		p->n = 1;						\
+	}								\
+	else if(x >= -1 && x < 0)					\
+		hyperpush##S(p,1,a,b,c,x);				\
+	else if(x < -1){						\
+		if(nearint##S(a-b)){					\
+			hyperpush##S(p,1,a,b,c,x);			\
+			return;						\
+		}							\
+		g = hyperinv##S(k);					\
+		hyperpush##S(p,g[0]*POW(1-x,-a),a,c-b,a-b+1,1/(1-x));	\
+		hyperpush##S(p,g[1]*POW(1-x,-b),b,c-a,b-a+1,1/(1-x));	\
+	}								\
+	else if(x < 1){							\
+		if(nearint##S(s)){					\
+			p->coef[0] = 1;					\
+			p->a[0] = a;					\
+			p->b[0] = b;					\
+			p->c[0] = c;					\
+			p->x[0] = x;					\
+			p->n = 1;					\
+			return;						\
+		}							\
+		g = hyperrefl##S(k);					\
+		hyperpush##S(p,g[0],a,b,1-s,1-x);			\
+		hyperpush##S(p,g[1]*POW(1-x,s),c-a,c-b,1+s,1-x);	\
+	}								\
+	else if(x == 1)							\
+		hyperpush##S(p,s > 0 ? hyperrefl##S(k)[0] : HUGE_VAL,a,b,c,0);	\
+	else if(x <= 2){						\
+		if(nearint##S(s)){					\
+			hyperpush##S(p,NAN,a,b,c,0);			\
+			return;						\
+		}							\
+		g = hyperrefl##S(k);					\
+		hyperpush##S(p,g[0],a,b,1-s,1-x);			\
+		hyperpush##S(p,g[1]*POW(x-1,s)*COS(PI*s),c-a,c-b,1+s,1-x);	\
+	}								\
+	else {								\
+		if(nearint##S(a-b)){					\
+			hyperpush##S(p,NAN,a,b,c,0);			\
+			return;						\
+		}							\
+		g = hyperinv##S(k);					\
+		hyperpush##S(p,g[0]*POW(x,-a)*COS(PI*a),a,a-c+1,a-b+1,1/x);	\
+		hyperpush##S(p,g[1]*POW(x,-b)*COS(PI*b),b,b-c+1,b-a+1,1/x);	\
+	}								\
+}									\
+									\
+static void hyperreduce##S(T a, T b, T c, T x, struct hyperplan##S *p)	\
+{									\
+	struct hypercoef##S k;						\
+									\
+	hypercoefinit##S(&k,a,b,c);					\
+	hyperreducek##S(&k,x,p);					\
+}									\
+									\
+static T hyperderror##S(struct hyperplan##S *p, int k, T derror)	\
+{									\
+	T w = FABS(p->coef[k]);						\
+									\
+	if(w == 0 || w != w || p->x[k] == 0)return 0;			\
+	return w > 1 ? derror/w : derror;				\
+}									\
+									\
+int hypersumr##S(T a, T b, T c, T x, T derror, long maxterms, T *f,	\
+		T *err, long *terms)					\
+{									\
+	T rval = 1, n = 1, term = a*b*x/c, K, C;			\
+	int status = HYPER_OK;						\
+									\
+	K = FMAX(FABS(a),FMAX(FABS(b),FABS(c)));			\
+	do {								\
+		C = 1 + 6*K/n + 2*(K/n)*(K/n);				\
+		if(term == 0)break;					\
+		if((n>2*K) && (C*x < 1) && (FABS(term)/(1 - C*x) < derror))	\
+			break;						\
+		if(maxterms > 0 && n >= maxterms){			\
+			status = HYPER_NOCONV;				\
+			break;						\
+		}							\
+		rval += term;						\
+		a += 1;							\
+		b += 1;							\
+		c += 1;							\
+		n += 1;							\
+		term = term*a*b*x/(n*c);				\
+	} while(1);							\
+	*f = rval;							\
+	*terms = (long)n;						\
+	if(err){							\
+		if(term == 0)*err = 0;					\
+		else if((n>2*K) && (C*x < 1))*err = FABS(term)/(1 - C*x);	\
+		else *err = HUGE_VAL;					\
+	}								\
+	return status;							\
+}									\
+									\
+T hypersumn##S(T a, T b, T c, T x, T derror, int *terms)		\
+{									\
+	T rval;								\
+	long n;								\
+									\
+	hypersumr##S(a,b,c,x,derror,0,&rval,NULL,&n);			\
+	if(terms)*terms = (int)n;					\
+	return rval;							\
+}									\
+									\
+T hypern##S(T a, T b, T c, T x, T derror, int *terms)			\
+{									\
+	struct hyperplan##S p;						\
+	T rval = 0, e;							\
+	int k,nt,total = 0;						\
+									\
+	hyperreduce##S(a,b,c,x,&p);					\
+	for(k=0;k<p.n;k++){						\
+		if((e = hyperderror##S(&p,k,derror)) == 0){		\
+			rval += p.coef[k];				\
+			continue;					\
+		}							\
+		rval += p.coef[k]*hypersumn##S(p.a[k],p.b[k],p.c[k],	\
+				p.x[k],e,&nt);				\
+		total += nt;						\
+	}								\
+	if(terms)*terms = total;					\
+	return rval;							\
+}
+
+HYPER_CORE(double,,fabs,floor,fmax,pow,cos,tgamma,sqrt,M_PI,DBL_EPSILON)
+HYPER_CORE(long double,l,fabsl,floorl,fmaxl,powl,cosl,tgammal,sqrtl,
+		3.141592653589793238462643383279502884L,LDBL_EPSILON)
+#ifdef QUAD
+HYPER_CORE(__float128,q,fabsq,floorq,fmaxq,powq,cosq,tgammaq,sqrtq,M_PIq,
+		FLT128_EPSILON)
+#endif
+
+/* Sum the series of a plan with the given summation routine, and combine
+ * them. */
+
+static double hyperplansum(struct hyperplan *p, double derror,
+		double (*sum)(double, double, double, double, double, int *),
+		int *terms)
+{
+	double rval = 0, e;
+	int k,nt,total = 0;
+
+	for(k=0;k<p->n;k++){
+		if((e = hyperderror(p,k,derror)) == 0.0){
+			rval += p->coef[k];
+			continue;
+		}
+		rval += p->coef[k]*(*sum)(p->a[k],p->b[k],p->c[k],p->x[k],e,&nt);
+		total += nt;
+	}
+	if(terms)*terms = total;
+	return rval;
+}
+
 /* hyper: Compute the hypergeometric function F(a,b,c;x) to within
  * an error < derror.
  *
- * As explained in the header, we use an identity to handle x <= 0
- * and 0 < x < 1 separately. The hypersum routine does the real work.
+ * As explained in the header, we transform the argument into [0,1/2]
+ * using hyperreduce. The hypersum routine does the real work.
  *
- * Return the result as a double. 
+ * Return the result as a double. hypern (defined by HYPER_CORE above)
+ * is the same, but if terms is not NULL also stores there the number of
+ * series terms that were summed.
  */
 
 double hyper(double a, double b, double c, double x, double derror)
 {
-	double xx=x,rval = 0;
+	return hypern(a,b,c,x,derror,NULL);
+}
 
-	if(x <= 0){
-		x = x/(x-1.0);
-		b = c - b;
-	}
-	rval = hypersum(a,b,c,x,derror);
-	if(xx <= 0)
-		rval *= pow(1.0-xx,-a); /* use original x */
+/* hyperp: the same as hypern, but in the given precision, one of the
+ * PREC_ constants. The result is rounded to double. PREC_QUAD is only
+ * available if this file is compiled with -DQUAD; otherwise it falls back
+ * to PREC_LONG. */
 
-	return rval;
+double hyperp(double a, double b, double c, double x, double derror,
+		int prec, int *terms)
+{
+	struct hyperplan p;
+
+	switch(prec){
+		case PREC_KAHAN:
+			hyperreduce(a,b,c,x,&p);
+			return hyperplansum(&p,derror,hypersumk,terms);
+		case PREC_LONG:
+			return hypernl(a,b,c,x,derror,terms);
+		case PREC_QUAD:
+#ifdef QUAD
+			return hypernq(a,b,c,x,derror,terms);
+#else
+			return hypernl(a,b,c,x,derror,terms);
+#endif
+		default:
+			return hypern(a,b,c,x,derror,terms);
+	}
 }
 
 /* hypersum: return the value of F(a,b,c;x) to within error < derror.
  *
  * We compute the hypergeometric function by summing the hypergeometric
- * series. This will only converge when |x| < 1. The caller might use
- * any known transformation of argument identities to reduce computation
- * of the analytically continued function to the case |x| < 1.
+ * series. This will only converge when |x| < 1, or when the series
+ * terminates. The caller might use any known transformation of argument
+ * identities to reduce computation of the analytically continued function
+ * to the case |x| < 1.
  *
  * It is up to the caller to do sanity checking on the argument and
  * parameters. If fed bad values, this routine may churn away forever
- * or cause an exception.
+ * or cause an exception. Callers that cannot do so should use hypersumr
+ * or hyperr, which take a budget of terms. hypersumn (defined by
+ * HYPER_CORE above) is the same, but if terms is not NULL also stores
+ * there the number of terms summed.
  */
 
 double hypersum(double a, double b, double c, double x, double derror)
+{
+	return hypersumn(a,b,c,x,derror,NULL);
+}
+
+/* hyperr: compute F(a,b,c;x) into *f, like hypern, but within a budget of
+ * maxterms series terms in all (no limit if maxterms <= 0), and reporting
+ * what happened. The number of terms summed goes to *terms and an
+ * estimate of the absolute error to *err. Either pointer may be NULL. The
+ * return value is
+ *
+ *	HYPER_OK	*f is within *err of F, and the rounding error
+ *			is below derror.
+ *	HYPER_NOCONV	The budget ran out. *f is a partial sum, and *err
+ *			says how good it is, or is HUGE_VAL if unknown.
+ *	HYPER_DOMAIN	A parameter is NaN, derror is not positive, or x > 1
+ *			falls in one of the degenerate cases of
+ *			hyperreduce. *f is NaN.
+ *	HYPER_POLE	c is a pole (0, -1, -2, ... and the series does not
+ *			terminate first), or x = 1 and c-a-b <= 0. *f is
+ *			HUGE_VAL or NaN.
+ *	HYPER_INEXACT	The series were summed to within derror, but
+ *			rounding in combining them may be larger. *f is
+ *			within *err of F.
+ *
+ * Near the degenerate cases of hyperreduce the coefficients of the two
+ * series are large and their terms cancel, so each adds HYPER_ULPS
+ * rounding errors of the size of its term, |coef*F_k|*DBL_EPSILON, to
+ * *err, besides its bound for the tail of its series.
+ *
+ * hyperr uses no static data and the math library functions it calls are
+ * reentrant, so it may be called from many threads at once.
+ */
+
+#define HYPER_ULPS 4
+
+int hyperr(double a, double b, double c, double x, double derror,
+		long maxterms, double *f, double *err, long *terms)
+{
+	struct hyperplan p;
+	double rval = 0, e, sf, se, etotal = 0, eround = 0;
+	long nt, total = 0;
+	int k, status = HYPER_OK;
+
+	if(terms)*terms = 0;
+	if(err)*err = 0.0;
+	if(a != a || b != b || c != c || x != x || !(derror > 0)){
+		*f = NAN;
+		return HYPER_DOMAIN;
+	}
+	if(c <= 0 && isint(c) && !(a <= 0 && isint(a) && a > c) &&
+			!(b <= 0 && isint(b) && b > c)){
+		*f = NAN;
+		return HYPER_POLE;
+	}
+
+	hyperreduce(a,b,c,x,&p);
+	for(k=0;k<p.n;k++){
+		if((e = hyperderror(&p,k,derror)) == 0.0){
+			rval += p.coef[k];
+			continue;
+		}
+		if(maxterms > 0 && total >= maxterms){
+			status = HYPER_NOCONV;
+			etotal = HUGE_VAL;
+			break;
+		}
+		if(hypersumr(p.a[k],p.b[k],p.c[k],p.x[k],e,
+				maxterms > 0 ? maxterms - total : 0,
+				&sf,&se,&nt) != HYPER_OK)
+			status = HYPER_NOCONV;
+		rval += p.coef[k]*sf;
+		etotal += fabs(p.coef[k])*se;
+		eround += HYPER_ULPS*DBL_EPSILON*fabs(p.coef[k]*sf);
+		total += nt;
+	}
+	etotal += eround;
+	if(status == HYPER_OK && eround > derror)
+		status = HYPER_INEXACT;
+
+	*f = rval;
+	if(terms)*terms = total;
+	if(err)*err = etotal;
+	if(rval != rval)return HYPER_DOMAIN;
+	if(rval == HUGE_VAL || rval == -HUGE_VAL)return HYPER_POLE;
+	return status;
+}
+
+/* hypersumk: the same as hypersumn, but the terms are added with
+ * Neumaier's variant of Kahan's compensated summation. The rounding error
+ * of each addition is accumulated separately and added back at the end,
+ * so that the sum is as accurate as if it were carried out in twice the
+ * working precision. This costs a few more floating point operations per
+ * term, and helps most when terms of alternating sign cancel. */
+
+double hypersumk(double a, double b, double c, double x, double derror,
+		int *terms)
 {
 
-	double rval = 1.0;
+	double rval = 1.0, comp = 0.0, t;
 	double n = 1.0;
 	double term = a*b*x/c;
 	double K;
 
-	/* find max(|a|,|b|,|c|) for use below */
-	K = fabs(a) ? fabs(b) : fabs(a) > fabs(b);
-	K = K ? fabs(c) : K > fabs(c);
+	K = fmax(fabs(a),fmax(fabs(b),fabs(c)));
 
 	do {
 	double C;
-		/* Decide whether we are accurate enough yet, i.e., if
-		 * tail of hypergeometric series < derror. Let An be nth term
-		 * of series, and Bn = (a+n)(b+n)/[(c+n)(1+n)]. Then
-		 * An+1/An = Bnx. Bn --> 1, which gives radius of convergence
-		 * 1. Let Cn be a monotone nonincreasing upper bound for |Bn|
-		 * Then by comparison with geometric series, |An|/(1-Cnx) < 
-		 * derror is sufficient to ensure accuracy. If we let K be
-		 * the max of |a|,|b|,|c|, then it is easy to check that
-		 * Cn = 1 + 6K/n + 2(K/n)^2 is such a monotone upper bound when
-		 * n > 2K.  
-		 */
+		/* See hypersumn for the test */
 
 		C = 1.0 + 6.0*K/n + 2.0*(K/n)*(K/n);
+		if(term == 0.0)break;
 		if((n>2.0*K) && (C*x < 1) && (fabs(term)/(1 - C*x) < derror))break;
 
-		rval += term;
+		t = rval + term;
+		if(fabs(rval) >= fabs(term))
+			comp += (rval - t) + term;
+		else comp += (term - t) + rval;
+		rval = t;
 		a += 1.0;
 		b += 1.0;
 		c += 1.0;
@@ -398,7 +1567,172 @@ double hypersum(double a, double b, double c, double x, double derror)
 		term = term*a*b*x/(n*c);
 
 	} while(1);   
-	return rval;
+	if(terms)*terms = (int)n;
+	return rval + comp;
+}
+
+/* hypergrid: set f[i] = F(a[i],b[i],c[i];x[i]) for 0 <= i < m, each to
+ * within an error < derror. If terms is not NULL, terms[i] is set to the
+ * number of series terms summed for f[i].
+ *
+ * The points are reduced by hyperreduce, GRID_CHUNK at a time, and the
+ * resulting series are summed HYPER_LANES at a time. The gamma function
+ * coefficients of the reductions are kept in a small cache, so points
+ * sharing (a,b,c) compute them only once. On each pass of the summation
+ * every lane does one step of the recurrence term = term*a*b*x/(n*c), and
+ * a lane whose tail passes the convergence test of hypersum is masked
+ * off, i.e., stops adding terms to its sum. A group is finished when all
+ * lanes are masked. The inner loops have no branches so the compiler can
+ * vectorize them. Since each lane does exactly the arithmetic hypersum
+ * would, the results agree with hyper to the bit.
+ *
+ * The remark in hypersum about bad parameters applies here as well.
+ */
+
+#define GRID_CHUNK 256
+#define COEF_CACHE 64	/* a power of 2 */
+
+/* Slot of the hypergrid coefficient cache for (a,b,c) */
+
+static unsigned hyperhash(double a, double b, double c)
+{
+	unsigned long long u[3],h;
+
+	memcpy(u,&a,sizeof(double));
+	memcpy(u+1,&b,sizeof(double));
+	memcpy(u+2,&c,sizeof(double));
+	h = (u[0]*0x9e3779b97f4a7c15ULL ^ u[1])*0x9e3779b97f4a7c15ULL ^ u[2];
+	h *= 0x9e3779b97f4a7c15ULL;
+	return (unsigned)(h >> 32) & (COEF_CACHE - 1);
+}
+
+void hypergrid(int m, double *a, double *b, double *c, double *x,
+		double derror, double *f, int *terms)
+{
+	struct hyperplan p[GRID_CHUNK];
+	struct hypercoef cache[COEF_CACHE],*kc;
+	int valid[COEF_CACHE];
+	double sa[2*GRID_CHUNK],sb[2*GRID_CHUNK],sc[2*GRID_CHUNK];
+	double sx[2*GRID_CHUNK],se[2*GRID_CHUNK],sf[2*GRID_CHUNK];
+	int sn[2*GRID_CHUNK];
+	double la[HYPER_LANES],lb[HYPER_LANES],lc[HYPER_LANES];
+	double lx[HYPER_LANES],lK[HYPER_LANES],le[HYPER_LANES];
+	double term[HYPER_LANES],rval[HYPER_LANES],nt[HYPER_LANES];
+	double live[HYPER_LANES];
+	double n,active;
+	int i,j,k,l,w,q,ns;
+
+	for(k=0;k<COEF_CACHE;k++)
+		valid[k] = 0;
+	for(i=0;i<m;i+=GRID_CHUNK){
+
+		/* Reduce the points of this chunk, and collect the series
+		 * which need summing. */
+
+		q = m - i < GRID_CHUNK ? m - i : GRID_CHUNK;
+		ns = 0;
+		for(j=0;j<q;j++){
+			kc = cache + hyperhash(a[i+j],b[i+j],c[i+j]);
+			if(!valid[kc-cache] || kc->a != a[i+j] ||
+					kc->b != b[i+j] || kc->c != c[i+j]){
+				hypercoefinit(kc,a[i+j],b[i+j],c[i+j]);
+				valid[kc-cache] = 1;
+			}
+			hyperreducek(kc,x[i+j],p+j);
+			for(k=0;k<p[j].n;k++){
+				if((se[ns] = hyperderror(p+j,k,derror)) == 0.0)
+					continue;
+				sa[ns] = p[j].a[k];
+				sb[ns] = p[j].b[k];
+				sc[ns] = p[j].c[k];
+				sx[ns] = p[j].x[k];
+				ns++;
+			}
+		}
+
+		for(j=0;j<ns;j+=HYPER_LANES){
+
+			/* Load the lanes, padding a short final group with
+			 * the trivial series F(1,1,1;0), which converges at
+			 * once. */
+
+			w = ns - j < HYPER_LANES ? ns - j : HYPER_LANES;
+			for(l=0;l<HYPER_LANES;l++){
+				if(l < w){
+					la[l] = sa[j+l];
+					lb[l] = sb[j+l];
+					lc[l] = sc[j+l];
+					lx[l] = sx[j+l];
+					le[l] = se[j+l];
+				}
+				else {
+					la[l] = lb[l] = lc[l] = 1.0;
+					lx[l] = 0.0;
+					le[l] = derror;
+				}
+				lK[l] = fmax(fabs(la[l]),fmax(fabs(lb[l]),
+							fabs(lc[l])));
+				rval[l] = 1.0;
+				term[l] = la[l]*lb[l]*lx[l]/lc[l];
+				live[l] = 1.0;
+				nt[l] = 1.0;
+			}
+
+			n = 1.0;
+			do {
+				/* See hypersum for the convergence test */
+
+				for(l=0;l<HYPER_LANES;l++){
+					double C = 1.0 + 6.0*lK[l]/n
+						+ 2.0*(lK[l]/n)*(lK[l]/n);
+					int conv = (term[l] == 0.0)
+						| ((n>2.0*lK[l]) & (C*lx[l] < 1)
+						& (fabs(term[l])/(1 - C*lx[l])
+							< le[l]));
+
+					live[l] = conv ? 0.0 : live[l];
+					rval[l] += live[l]*term[l];
+					nt[l] += live[l];
+				}
+				active = 0.0;
+				for(l=0;l<HYPER_LANES;l++)
+					active += live[l];
+				n += 1.0;
+				for(l=0;l<HYPER_LANES;l++){
+					la[l] += 1.0;
+					lb[l] += 1.0;
+					lc[l] += 1.0;
+					term[l] = term[l]*la[l]*lb[l]*lx[l]
+						/(n*lc[l]);
+				}
+			} while(active > 0.0);
+
+			for(l=0;l<w;l++){
+				sf[j+l] = rval[l];
+				sn[j+l] = (int)nt[l];
+			}
+		}
+
+		/* Combine the sums, in the order hypern does. */
+
+		ns = 0;
+		for(j=0;j<q;j++){
+			double r = 0;
+			int t = 0;
+
+			for(k=0;k<p[j].n;k++){
+				if(hyperderror(p+j,k,derror) == 0.0){
+					r += p[j].coef[k];
+					continue;
+				}
+				r += p[j].coef[k]*sf[ns];
+				t += sn[ns];
+				ns++;
+			}
+			f[i+j] = r;
+			if(terms)terms[i+j] = t;
+		}
+	}
 }
 
 /* Generic routine to get a line of data from the user, presumably
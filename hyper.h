@@ -0,0 +1,61 @@
+/* hyper.h: the interface of hyper.c, for programs that link with
+ * libhyper.a (or hyper.o compiled with -DNO_MAIN).
+ *
+ * See the comments at the top of hyper.c, and above each definition there,
+ * for what these do. To use the __float128 routines, define QUAD before
+ * including this file, compile hyper.c with -DQUAD, and link with
+ * -lquadmath.
+ */
+
+#ifndef HYPER_H
+#define HYPER_H
+
+/* Precisions for hyperp */
+
+#define PREC_DOUBLE 0
+#define PREC_KAHAN 1
+#define PREC_LONG 2
+#define PREC_QUAD 3
+
+/* Return values of hyperr and hypersumr */
+
+#define HYPER_OK 0
+#define HYPER_NOCONV 1
+#define HYPER_DOMAIN 2
+#define HYPER_POLE 3
+#define HYPER_INEXACT 4
+
+double hyper(double a, double b, double c, double x, double derror);
+double hypern(double a, double b, double c, double x, double derror,
+		int *terms);
+double hypersum(double a, double b, double c, double x, double derror);
+double hypersumn(double a, double b, double c, double x, double derror,
+		int *terms);
+double hypersumk(double a, double b, double c, double x, double derror,
+		int *terms);
+int hypersumr(double a, double b, double c, double x, double derror,
+		long maxterms, double *f, double *err, long *terms);
+int hyperr(double a, double b, double c, double x, double derror,
+		long maxterms, double *f, double *err, long *terms);
+void hypergrid(int m, double *a, double *b, double *c, double *x,
+		double derror, double *f, int *terms);
+double hyperp(double a, double b, double c, double x, double derror,
+		int prec, int *terms);
+long double hypernl(long double a, long double b, long double c,
+		long double x, long double derror, int *terms);
+long double hypersumnl(long double a, long double b, long double c,
+		long double x, long double derror, int *terms);
+int hypersumrl(long double a, long double b, long double c, long double x,
+		long double derror, long maxterms, long double *f,
+		long double *err, long *terms);
+#ifdef QUAD
+__float128 hypernq(__float128 a, __float128 b, __float128 c, __float128 x,
+		__float128 derror, int *terms);
+__float128 hypersumnq(__float128 a, __float128 b, __float128 c,
+		__float128 x, __float128 derror, int *terms);
+int hypersumrq(__float128 a, __float128 b, __float128 c, __float128 x,
+		__float128 derror, long maxterms, __float128 *f,
+		__float128 *err, long *terms);
+#endif
+
+#endif /* HYPER_H */
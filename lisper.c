@@ -26,9 +26,42 @@
  * expression will be nested to at least the desired depth. The bias parameter
  * ensures that pushes are more likely than pops until the minimum depth is
  * achieved. Thereafter pops are more likely.   
+ *
+ * The walk does not give every expression of a given length the same
+ * chance, nor a length chosen in advance. With -l n, the program instead
+ * prints an expression of exactly n pairs, every one of the C(n) =
+ * (2n)!/(n!(n+1)!) (Catalan number) such expressions being equally likely.
+ * It uses the cycle lemma (Dvoretzky and Motzkin, 1947): arrange n "(" and
+ * n+1 ")" in a random order. Of the 2n+1 rotations of the result, exactly
+ * one is an expression followed by a single extra ")", namely the one
+ * starting just after the first place where the excess of ")" over "("
+ * is largest. Each expression therefore comes from exactly 2n+1 of the
+ * equally likely arrangements, so all are equally likely, and the work is
+ * proportional to n. If -d k is also given, the expression is k nested
+ * pairs around a random expression of n-k pairs, so that it is nested to
+ * depth at least k; -d n gives the deepest expression, ((( ... ))).
  */
 
-/* compile: cc -o lisper lisper.c
+/* compile: cc -o lisper lisper.c -lpthread
+
+      With -count n, n expressions are printed, one per line, for use as
+        test input for parsers. With -l as well, they are uniform samples
+        of the given length. This mode is built for speed: random
+        numbers come from the xoshiro256** generator of D. Blackman and
+        S. Vigna (see https://prng.di.unimi.it/) rather than from random(),
+        each 64-bit output making two push/pop decisions, and the output
+        is collected in large buffers that are written with fwrite. The
+        number of bytes written per second is reported on stderr, with
+        histograms of the depths and lengths of the expressions. A C99
+        compiler is needed for stdint.h. For a given seed the expressions
+        are the same on every system, but they are not the ones the
+        single expression mode makes from that seed.
+
+      With -j, the expressions of -count are made on several threads.
+        Each expression has its own random number stream, seeded from
+        the -s seed and its number (see rng_stream below), and the
+        threads' buffers are written in order, so the output for a given
+        seed is the same whatever the number of threads.
 
       Use -D_NO_RANDOM if your library doesn't have random/srandom. Most do,
        	but the only truly portable RNG is rand/srand. Unfortunately it has
@@ -49,19 +82,29 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<string.h>
 #include<math.h>
 #include<time.h>
+#include<stdint.h>
+#include<limits.h>
+#include<pthread.h>
 
-#define VERSION "1.0"
-#define USAGE "lisper [ -b <n> -d <n> -s <n> -h -v]"
+#define VERSION "1.3"
+#define USAGE "lisper [ -b <n> -d <n> -s <n> -l <n> -count <n> -j <n> -h -v]"
 #ifndef _SHORT_STRINGS
-#define HELP "\n\nlisper [ -b <n> -d <n> -s <n> -h -v ]\n\n\
+#define HELP "\n\nlisper [ -b <n> -d <n> -s <n> -l <n> -count <n> -j <n> -h -v ]\n\n\
 Print a random well-formed parenthesis expression. \n\n\
 -s: Use next argument as RNG seed. (Otherwise use system time as seed.)\n\
 -b: Use next argument as the bias parameter. (0 <= n <= 0.5. Default=0.1.) \n\
     Smaller values tend to produce longer expressions.\n\
 -d: Use next argument as minimum depth parameter. (Default=4.) The\n\
     generated expression will be nested to at least this depth.\n\
+-l: Print an expression of exactly next argument many pairs, chosen\n\
+    uniformly from all such. With -d k, it is nested to depth at least k.\n\
+-count: Print next argument many expressions, one per line, as fast as \n\
+    possible, and report the rate in MB/s and histograms of depth and\n\
+    length on stderr.\n\
+-j: Use next argument many threads for -count. (Default=1.)\n\
 -v: Print version number and exit. \n\
 -h: Print this helpful information. \n\n"
 #else
@@ -81,6 +124,19 @@ Print a random well-formed parenthesis expression. \n\n\
 #define BIAS .1
 #define MIN_DEPTH 4
 #define INITIAL_SEED 2718
+
+/* Largest -l. The arrangement's length, 2n+1, must fit in 32 bits. */
+#define MAX_PAIRS ((1L<<31)-1)
+
+/* Size of the output buffers for -count */
+#ifndef OUTBUF
+#define OUTBUF (1<<20)
+#endif
+
+/* Expressions per block for -count, without -l */
+#define BLOCK 1024
+
+#define MAX_THREADS 64
 #ifndef _MAX_RAND
 #define _MAX_RAND RAND_MAX
 #endif
@@ -107,6 +163,394 @@ void pop(void)
 	depth--;
 }
 
+/* The state of an xoshiro256** generator */
+
+struct rng {
+	uint64_t s[4];
+};
+
+static uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Return the next 64 random bits */
+
+static uint64_t rng_next(struct rng *r)
+{
+	uint64_t *s = r->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+/* Initialize the state from a seed, by way of the splitmix64 generator,
+   so that similar seeds give unrelated states. */
+
+static void rng_seed(struct rng *r, uint64_t seed)
+{
+	int i;
+	uint64_t z;
+
+	for(i=0;i<4;i++){
+		z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		r->s[i] = z ^ (z >> 31);
+	}
+}
+
+/* Initialize the stream for expression k of -count: the four words of its
+   state are outputs 4k+1 ... 4k+4 of the splitmix64 sequence started at
+   seed, so every expression has its own numbers, which depend only on
+   seed and k, not on which thread makes it. */
+
+static void rng_stream(struct rng *r, uint64_t seed, uint64_t k)
+{
+	rng_seed(r, seed + 4*k*0x9e3779b97f4a7c15ULL);
+}
+
+/* An output buffer for -count, in memory. It grows as needed, so that a
+   thread can hold a whole block of expressions until its turn to write
+   them comes. */
+
+struct out {
+	char *buf, *p, *end;
+};
+
+static void out_grow(struct out *o)
+{
+	long used = o->p - o->buf, size = 2*(o->end - o->buf);
+
+	if((o->buf = realloc(o->buf,size)) == NULL){
+		fprintf(stderr,"lisper: out of memory\n");
+		exit(1);
+	}
+	o->p = o->buf + used;
+	o->end = o->buf + size;
+}
+
+#define PUT(o,c) do { if((o)->p == (o)->end) out_grow(o); \
+*(o)->p++ = (c); } while(0)
+
+/* expr: the single expression mode's walk, done fast, into the buffer o.
+   Each 64-bit random number gives two 32-bit uniforms, and a push is
+   made when one is below t = (0.5+bias)*2^32 (above it, once depth md is
+   reached), which is the same as comparing U() with 0.5+bias. Pushes and
+   pops are random, so branching on them would be mispredicted half the
+   time; instead ')' is written as '('+1, and a pop at depth 0 is undone
+   by not advancing the output pointer. Returns the depth. */
+
+static int expr(struct rng *r, struct out *o, uint64_t t, int md)
+{
+	uint64_t x = 0, u;
+	int halves = 0, depth = 0, maxd = md, push;
+
+	while(depth < md){ /* bias deeper until min depth exceeded */
+		if(halves == 0){
+			x = rng_next(r);
+			halves = 2;
+		}
+		u = x & 0xffffffff;
+		x >>= 32;
+		halves--;
+		push = u < t;
+		if(o->p == o->end)
+			out_grow(o);
+		*o->p = ')' - push;
+		o->p += push | (depth != 0);
+		depth += push ? 1 : (depth != 0 ? -1 : 0);
+	}
+	while(depth){ /* bias shallower until we return to balance */
+		if(halves == 0){
+			x = rng_next(r);
+			halves = 2;
+		}
+		u = x & 0xffffffff;
+		x >>= 32;
+		halves--;
+		push = u >= t;
+		PUT(o,')' - push);
+		depth += 2*push - 1;
+		maxd = depth > maxd ? depth : maxd;
+	}
+	PUT(o,'\n');
+	return maxd;
+}
+
+/* Return a random integer, uniform on 0,1,...,n-1. This is D. Lemire's
+   method: the top half of a 32 by 32 bit product, with a rejection step
+   that is rarely taken and makes the result exactly uniform. */
+
+static uint32_t rng_below(struct rng *r, uint32_t n)
+{
+	uint64_t m = (rng_next(r) >> 32) * n;
+	uint32_t t;
+
+	if((uint32_t)m < n){
+		t = -n % n;
+		while((uint32_t)m < t)
+			m = (rng_next(r) >> 32) * n;
+	}
+	return m >> 32;
+}
+
+/* Write the len bytes at s to the buffer o */
+
+static void out_write(struct out *o, char *s, long len)
+{
+	long k;
+
+	while(len > 0){
+		if(o->p == o->end)
+			out_grow(o);
+		k = o->end - o->p;
+		if(k > len)
+			k = len;
+		memcpy(o->p,s,k);
+		o->p += k;
+		s += k;
+		len -= k;
+	}
+}
+
+/* uniform: write to o an expression of n pairs, chosen uniformly, nested
+   in k more pairs. w must have room for 2n+1 characters. The arrangement
+   of n "(" and n+1 ")" is made one character at a time, each being "("
+   with probability (number of "(" left)/(number of characters left),
+   which gives every arrangement the same chance. s is the number of "("
+   less the number of ")" so far, and first is where it first reaches its
+   least value; the expression is the rotation that starts after that,
+   less its last ")". (See the top of the file.) Its depth is the greatest
+   s after first, or one less than the greatest before, less the least;
+   these are kept as we go. Returns the depth, counting the k pairs. */
+
+static long uniform(struct rng *r, struct out *o, char *w, long n, long k)
+{
+	long i, first = 0, s = 0, min = 0, hi = 0, before = LONG_MIN, after;
+	uint32_t left = 2*n+1, up = n;
+	int push;
+
+	after = LONG_MIN;
+	for(i=0;i<2*n+1;i++){
+		push = rng_below(r,left--) < up;
+		up -= push;
+		w[i] = ')' - push;
+		s += 2*push - 1;
+		if(s < min){
+			min = s;
+			first = i;
+			before = hi;
+			after = LONG_MIN;
+		}
+		else
+			after = s > after ? s : after;
+		hi = s > hi ? s : hi;
+	}
+	for(i=0;i<k;i++)
+		PUT(o,'(');
+	out_write(o,w+first+1,2*n-first);
+	out_write(o,w,first);
+	for(i=0;i<k;i++)
+		PUT(o,')');
+	PUT(o,'\n');
+	if(first == 0)
+		before = LONG_MIN;
+	s = before == LONG_MIN ? min : before - 1;
+	if(after > s)
+		s = after;
+	return s - min + k;
+}
+
+/* Histograms of the depths and lengths of the expressions made by
+   -count. Entry b counts values from 2^(b-1) up to 2^b - 1, and entry 0
+   counts zeros. */
+
+#define NBUCKETS 65
+
+struct stats {
+	uint64_t depth[NBUCKETS], length[NBUCKETS];
+};
+
+static int bucket(uint64_t x)
+{
+	int b = 0;
+
+	while(x){
+		b++;
+		x >>= 1;
+	}
+	return b;
+}
+
+static void print_hist(char *name, uint64_t *h)
+{
+	int b;
+	uint64_t lo, hi;
+
+	fprintf(stderr,"%-24s %12s\n",name,"count");
+	for(b=0;b<NBUCKETS;b++){
+		if(h[b] == 0)
+			continue;
+		lo = b ? (uint64_t)1 << (b-1) : 0;
+		hi = b ? lo + (lo-1) : 0;
+		if(lo == hi)
+			fprintf(stderr,"%-24llu %12llu\n",(unsigned long long)lo,
+				(unsigned long long)h[b]);
+		else
+			fprintf(stderr,"%11llu - %-10llu %12llu\n",
+				(unsigned long long)lo,(unsigned long long)hi,
+				(unsigned long long)h[b]);
+	}
+}
+
+/* Stuff for -count. The expressions are made in blocks of block, which
+   the threads take in turn, numbered by next. Each thread makes a block
+   in its own buffer, then waits until written, the number of blocks
+   written so far, is its block's number, and writes it. So the output is
+   in order, and, since expression k is made from stream k, it is the same
+   whatever the number of threads. */
+
+struct gen {
+	long n, block, next, written;
+	uint64_t seed, t, bytes;
+	int md, failed;
+	long pairs;
+	struct stats st;
+	pthread_mutex_t lock;
+	pthread_cond_t turn;
+};
+
+static void *gen_work(void *arg)
+{
+	struct gen *g = arg;
+	struct rng r;
+	struct out o;
+	struct stats st;
+	char *w = NULL;
+	long b, i, lo, hi, start, depth;
+	int failed = 0;
+
+	if(g->pairs >= 0)
+		w = malloc(2*(g->pairs-g->md)+1);
+	if((o.buf = malloc(OUTBUF)) == NULL || (g->pairs >= 0 && w == NULL)){
+		fprintf(stderr,"lisper: out of memory\n");
+		exit(1);
+	}
+	o.p = o.buf;
+	o.end = o.buf + OUTBUF;
+	memset(&st,0,sizeof(st));
+
+	for(;;){
+		pthread_mutex_lock(&g->lock);
+		b = g->next++;
+		pthread_mutex_unlock(&g->lock);
+		lo = b*g->block;
+		if(lo >= g->n)
+			break;
+		hi = lo + g->block < g->n ? lo + g->block : g->n;
+		for(i=lo;i<hi;i++){
+			rng_stream(&r,g->seed,(uint64_t)i);
+			start = o.p - o.buf;
+			if(g->pairs >= 0)
+				depth = uniform(&r,&o,w,g->pairs-g->md,g->md);
+			else
+				depth = expr(&r,&o,g->t,g->md);
+			st.depth[bucket(depth)]++;
+			st.length[bucket(o.p - o.buf - start - 1)]++;
+		}
+
+		pthread_mutex_lock(&g->lock);
+		while(g->written != b)
+			pthread_cond_wait(&g->turn,&g->lock);
+		pthread_mutex_unlock(&g->lock);
+		if(fwrite(o.buf,1,o.p-o.buf,stdout) != (size_t)(o.p-o.buf))
+			failed = 1;
+		pthread_mutex_lock(&g->lock);
+		g->bytes += o.p - o.buf;
+		g->written++;
+		pthread_cond_broadcast(&g->turn);
+		pthread_mutex_unlock(&g->lock);
+		o.p = o.buf;
+	}
+
+	pthread_mutex_lock(&g->lock);
+	for(i=0;i<NBUCKETS;i++){
+		g->st.depth[i] += st.depth[i];
+		g->st.length[i] += st.length[i];
+	}
+	g->failed |= failed;
+	pthread_mutex_unlock(&g->lock);
+	free(o.buf);
+	free(w);
+	return NULL;
+}
+
+/* count_mode: print n expressions to stdout, made on nthreads threads,
+   and, if report is set, report the rate and the histograms. With pairs
+   >= 0, they are uniform ones of that many pairs, nested to depth md;
+   otherwise they are made by the walk. */
+
+static int count_mode(long n, long seed, double bias, int md, long pairs,
+	int nthreads, int report)
+{
+	struct gen g;
+	struct timespec t0, t1;
+	pthread_t id[MAX_THREADS];
+	double secs;
+	int j;
+
+	memset(&g,0,sizeof(g));
+	g.n = n;
+	g.seed = (uint64_t)seed;
+	g.t = (uint64_t)((0.5+bias)*4294967296.0);
+	g.md = md;
+	g.pairs = pairs;
+
+	/* Blocks of about OUTBUF bytes for -l; the walk's expressions are
+	   short on average. */
+
+	if(pairs >= 0)
+		g.block = OUTBUF/(2*pairs+1) > 1 ? OUTBUF/(2*pairs+1) : 1;
+	else
+		g.block = BLOCK;
+	pthread_mutex_init(&g.lock,NULL);
+	pthread_cond_init(&g.turn,NULL);
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	for(j=1;j<nthreads;j++)
+		if(pthread_create(&id[j],NULL,gen_work,&g)){
+			fprintf(stderr,"lisper: cannot create thread\n");
+			exit(1);
+		}
+	gen_work(&g);
+	for(j=1;j<nthreads;j++)
+		pthread_join(id[j],NULL);
+	if(fflush(stdout))
+		g.failed = 1;
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	pthread_mutex_destroy(&g.lock);
+	pthread_cond_destroy(&g.turn);
+
+	secs = (t1.tv_sec-t0.tv_sec) + 1e-9*(t1.tv_nsec-t0.tv_nsec);
+	if(report){
+		fprintf(stderr,"%ld expressions, %llu bytes in %.3f s on %d threads: %.1f MB/s\n",
+			n,(unsigned long long)g.bytes,secs,nthreads,
+			secs > 0 ? g.bytes/secs/1e6 : 0.0);
+		print_hist("depth",g.st.depth);
+		print_hist("length",g.st.length);
+	}
+	return g.failed;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -114,6 +558,10 @@ main(int argc, char **argv)
 	double bias = BIAS;
 	int md = MIN_DEPTH;
 	long seed=0;
+	long count = -1;
+	long pairs = -1;
+	int md_given = 0;
+	int nthreads = 1;
 
 	/* Process command line */
 
@@ -145,6 +593,43 @@ main(int argc, char **argv)
 						exit(1);
 					}
 					md = atoi(argv[j+1]);
+					md_given = 1;
+					j++;
+					continue;
+				case 'c':
+				case 'C':
+					/* -c or -count */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					count = atol(argv[j+1]);
+					j++;
+					continue;
+				case 'l':
+				case 'L':
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					pairs = atol(argv[j+1]);
+					if(pairs < 0){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					j++;
+					continue;
+				case 'j':
+				case 'J':
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					nthreads = atoi(argv[j+1]);
+					if(nthreads < 1)
+						nthreads = 1;
+					if(nthreads > MAX_THREADS)
+						nthreads = MAX_THREADS;
 					j++;
 					continue;
 				case 'v':
@@ -187,6 +672,20 @@ main(int argc, char **argv)
 			fprintf(stderr, "Using seed = %d\n",INITIAL_SEED);
 		}
 		
+	if(pairs >= 0){
+		if(!md_given)
+			md = 0;
+		if(md > pairs || pairs > MAX_PAIRS){
+			fprintf(stderr,"lisper: need depth <= pairs <= %ld.\n",
+				(long)MAX_PAIRS);
+			return 1;
+		}
+		return count_mode(count < 0 ? 1 : count,seed,bias,md,pairs,
+			nthreads,count >= 0);
+	}
+	if(count >= 0)
+		return count_mode(count,seed,bias,md,-1,nthreads,1);
+
 	/* Seed RNG */
 
 	SRANDOM((int)seed);
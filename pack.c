@@ -39,11 +39,27 @@
  *
  */
 
-/* compile: cc -o pack pack.c
+/* compile: cc -o pack pack.c -lm
 
       Use -D_SHORT_STRINGS if your compiler does not support multiline
           string constants.
 
+      The type whole below limits the size of x, y and z. -m 128 uses
+          128-bit z and 64-bit x and y instead, if the compiler has
+          unsigned __int128, and -m big uses integers of any size (see
+          big_add and friends below), so that any x and y, or any number
+          of values, can be packed. -bench times each mode.
+
+      -p szudzik packs with another pairing, and -tree packs more than two
+          values as a tree of pairs rather than iterated, which gives
+          much smaller keys (see pack_tuple below). -lengths compares the
+          key sizes of each.
+
+      -stream packs or unpacks large numbers of values read from stdin,
+          in blocks, through loops that the compiler can vectorize (see
+          pack_block below). For speed, compile with
+          cc -O3 -march=native -fno-math-errno -o pack pack.c -lm
+
       These are very slow and are included only to prove a point:
 
       Use -DPRIMITIVE_RECURSIVE to implement all functions as primitive 
@@ -51,6 +67,9 @@
 
       Use -DRECURSIVE to implement all functions as recursive functions.
 
+      Either way all the implementations of U are compiled in, and -u
+          chooses one at run time; -bench compares them.
+
 */
 
 /* Set these appropriately for your own platform: */
@@ -58,35 +77,60 @@
 #define USE_LONG_LONG   /* or USE_LONG or USE_INT */
 
 #include<stdio.h>
+#include<errno.h>
 #include<stdlib.h>
 #include<limits.h>
+#include<math.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<sys/resource.h>
 
 #ifdef USE_LONG_LONG
-#define CONVERT atoll
 #define TYPEMAX ULONG_LONG_MAX
 #define PRINT_AS "llu"  /* conversion after % in printf */
 typedef unsigned long long whole;  
 #endif
 #ifdef USE_LONG
-#define CONVERT atol
 #define TYPEMAX ULONG_MAX
 #define PRINT_AS "lu"
 typedef unsigned long whole;
 #endif
 #ifdef USE_INT
-#define CONVERT atoi
 #define TYPEMAX UINT_MAX
 #define PRINT_AS "u"
 typedef unsigned int whole;
 #endif
 
-#define VERSION "1.0"
-#define USAGE "pack [ -1 <z> -h -v] [x y]"
+#define VERSION "1.5"
+#define USAGE "pack [ -1 <z> -m <mode> -p <pairing> -tree -u <method> -k <n> -stream -f <fmt> -lengths <n> -w <b> -check <n> -bench <n> -h -v] [x y ...]"
 #ifndef _SHORT_STRINGS
-#define HELP "\n\npack [ -1 <z> -h -v ] [x y]\n\n\
+#define HELP "\n\npack [ -1 <z> -m <mode> -p <pairing> -tree -u <method> -k <n> -stream -f <fmt> -lengths <n> -w <b> -check <n> -bench <n> -h -v ] [x y ...]\n\n\
 Pack information in whole numbers x and y into a single whole number z and \n\
-print the result. \n\n\
+print the result. More than two values are packed by pairing repeatedly. \n\n\
 -1: Unpack the information in the whole number z and print result as x y.\n\
+-m: Use next argument as mode: whole (default), 128 (128-bit z) or big\n\
+    (any size).\n\
+-p: Use next argument as pairing: cantor (C, default) or szudzik (S, which\n\
+    gives keys up to a bit smaller). Not with -m 128.\n\
+-tree: Pack more than two values as a balanced tree of pairs, rather than\n\
+    iterated from the right. Keys are much smaller. Not with -m 128.\n\
+-u: Use next argument as the implementation of U, which head and tail\n\
+    use: sqrt (default), bisect, recursive (slow) or primitive (very slow,\n\
+    and recurses z deep, so sqrt is used if z is too big for the stack).\n\
+-k: With -1, unpack z into next argument many values. (Default=2.)\n\
+-stream: Pack pairs read from stdin, or with -1 (and no z) unpack numbers\n\
+    read from stdin, writing the results to stdout.\n\
+-f: Use next argument as format for -stream: text (default) or bin (arrays\n\
+    of whole numbers in machine format).\n\
+-lengths: Print the sizes of the keys of n random -k tuples of -w bit values\n\
+    with each pairing, iterated and as a tree.\n\
+-w: Use next argument as bits in each value for -lengths. (Default=32.)\n\
+-bench: Time packing and unpacking n random pairs in each mode (n/16 for\n\
+    big), then head and tail with each -u method on z of each size.\n\
+-check: Compare U with the bisection method on edge cases and n random\n\
+    numbers, check S on keys too big for C, and print the number of\n\
+    disagreements.\n\
 -v: Print version number and exit. \n\
 -h: Print this helpful information. \n\n"
 #else
@@ -109,6 +153,11 @@ whole V(whole z){
 }
 
 
+/* The largest n for which V(n) does not overflow. If whole has 2h bits, it
+ * is 2^h - 1, since V(2^h - 1) = 2^2h - 2^h and V(2^h) = 2^2h + 2^h. */
+
+#define NMAX ((((whole)1) << (sizeof(whole)*CHAR_BIT/2)) - 1)
+
 /* U, an integer valued "inverse" of V. I.e., U(x) is the unique whole
  * number n that satisfies
  *
@@ -116,7 +165,9 @@ whole V(whole z){
  *
  * */
 
-#ifdef PRIMITIVE_RECURSIVE
+/* There are four implementations of U, chosen among at run time with -u
+ * (see U below). */
+
 /* Implement U as a primitive recursive function. I claim that the
  * following is a recursion for U:
  *
@@ -140,36 +191,43 @@ whole V(whole z){
  * V(U(x)) <= x by the inductive hypothesis. OTOH, V(U(x+1)+1) = V(U(x)+1)
  * = U^2(x) + 3U(x) + 2 > x + 1. 
  *
- * For large z this is very slow and consumes lots of stack. */
+ * For large z this is very slow and consumes lots of stack: it recurses
+ * z deep. stack_low records the deepest point it has reached, for
+ * -bench. */
 
-whole U(whole z){
+static uintptr_t stack_low = UINTPTR_MAX;
+
+whole U_primitive(whole z){
 
 	whole w;
 
+	if((uintptr_t)&w < stack_low)
+		stack_low = (uintptr_t)&w;
 	if(z == 0)return 0;
-	w = U(z-1);
-	if(w*w + 3*w + 1 == z)return w + 1;
+	w = U_primitive(z-1);
+	if(w*w + 3*w + 1 == z-1)return w + 1;	/* the recursion with x = z-1 */
 	return w;
 }
-#elif defined( RECURSIVE )
-/* We use the "mu" operator, i.e., linear search for the largest n such
- * V(n) <= z. For large z this is slow. */
-whole U(whole z){
+/* Implement U as a recursive function. We use the "mu" operator, i.e.,
+ * linear search for the largest n such V(n) <= z. For large z this is
+ * slow. (i stops at NMAX, where V(i+1) would overflow.) */
+
+whole U_mu(whole z){
 
 	whole i = 0;
 
-	while(V(i+1) <= z)i++;
+	while(i < NMAX && V(i+1) <= z)i++;
 	return i;
 }
-#else 
 
 /* Implement U `efficiently'. Since this may be passed the largest possible
  * number representable, we must be careful not to generate anything larger
  * than z during the calculation. We use a bisection method and are
- * careful about the possibililty of overflow. 
+ * careful about the possibililty of overflow. This takes about as many
+ * steps as whole has bits; U_sqrt below does the same in a few.
 */ 
 
-whole U(whole z){
+whole U_bisect(whole z){
 
 	whole top = z, bot = 0,m,n;
 
@@ -183,9 +241,11 @@ whole U(whole z){
 		if((top==m)||(bot==m))break;
 
 		/* Head off the possibility that V(m) will overflow. */
-		/* First consider the possibility that m*m overflows. */
+		/* First consider the possibility that m*m overflows. (m is
+		   never 0 here. n == m only when m = 1, which does not
+		   overflow.) */
 		n = m*m;
-		if((n % m) || (n == m) || (n == 0)) { 
+		if((n % m) || (n == 0)) { 
 			top = m;
 			continue;
 		}
@@ -201,6 +261,93 @@ whole U(whole z){
 	}
 	return m;
 }
+
+/* Implement U in constant time. Solving n^2 + n = z gives
+ * n = (sqrt(4z+1) - 1)/2, so U(z) is the integer part of this. Computed in
+ * floating point, it may be off by one or two when z has more digits
+ * than a double holds, so it is corrected with exact integer
+ * arithmetic, first down until V(n) <= z, then up while V(n+1) <= z. n
+ * never exceeds NMAX, so V(n) and V(n+1) (when tested) do not overflow.
+ */
+
+whole U_sqrt(whole z){
+
+	double d = (sqrt(4.0*(double)z + 1.0) - 1.0)/2.0;
+	whole n = d < (double)NMAX ? (whole)d : NMAX;
+
+	while(V(n) > z)
+		n--;
+	while(n < NMAX && V(n+1) <= z)
+		n++;
+	return n;
+}
+
+/* primitive_limit: the largest z for which U_primitive fits in the stack
+ * limit, with a tenth to spare, or TYPEMAX if there is no limit. The first
+ * call measures the stack each level takes, into primitive_frame. */
+
+static double primitive_frame;
+static volatile whole sink;	/* results that must not be optimized away */
+
+static whole primitive_limit(void){
+
+	static whole limit = 0;
+	uintptr_t top;
+	struct rlimit rl;
+
+	if(limit == 0){
+		top = (uintptr_t)&rl;
+		stack_low = UINTPTR_MAX;
+		sink = U_primitive(10000);
+		primitive_frame = (top - stack_low)/10000.0;
+		limit = TYPEMAX;
+		if(getrlimit(RLIMIT_STACK,&rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+			&& (double)rl.rlim_cur/primitive_frame < (double)TYPEMAX)
+			limit = (whole)((0.9*rl.rlim_cur)/primitive_frame);
+	}
+	return limit;
+}
+
+/* U_primitive_safe: U_primitive, unless z is too big for the stack, in
+ * which case it says so (once) and uses U_sqrt. This is what -u primitive
+ * and -DPRIMITIVE_RECURSIVE select, so that a big z is not a crash. */
+
+whole U_primitive_safe(whole z){
+
+	static int warned = 0;
+
+	if(z > primitive_limit()){
+		if(!warned)
+			fprintf(stderr,"pack: z is too big for the primitive method in the stack limit. Using sqrt.\n");
+		warned = 1;
+		return U_sqrt(z);
+	}
+	return U_primitive(z);
+}
+
+/* U itself points to one of these: U_sqrt, unless compiled with
+ * -DPRIMITIVE_RECURSIVE or -DRECURSIVE, or changed with -u. */
+
+struct method {
+	char *name;
+	whole (*U)(whole z);
+};
+
+struct method methods[] = {
+	{"primitive", U_primitive_safe},
+	{"recursive", U_mu},
+	{"bisect", U_bisect},
+	{"sqrt", U_sqrt},
+};
+
+#define NMETHODS (int)(sizeof(methods)/sizeof(methods[0]))
+
+#ifdef PRIMITIVE_RECURSIVE
+whole (*U)(whole z) = U_primitive_safe;
+#elif defined( RECURSIVE )
+whole (*U)(whole z) = U_mu;
+#else
+whole (*U)(whole z) = U_sqrt;
 #endif
 
 whole head(whole z){
@@ -211,11 +358,1456 @@ whole tail(whole z){
 	return U(V(U(2*z))) - head(z);
 }
 
+/* Unpack z into *x = head(z) and *y = tail(z). Since U(V(n)) = n, only
+ * one U is needed. */
+
+void unpack(whole z, whole *x, whole *y){
+
+	whole n = U(2*z);
+
+	*x = (2*z - V(n))/2;
+	*y = n - *x;
+}
+
+/* Block kernels for -stream. These do pack and unpack on n values at a
+ * time, with no branches and no calls in their loops, so that the
+ * compiler can vectorize them: with gcc -O3 -march=native -fno-math-errno
+ * they run on SSE4.2, AVX2 or AVX-512 vectors as the machine has them,
+ * and compile to plain scalar loops elsewhere. (-fno-math-errno lets sqrt
+ * be vectorized.) whole must have at most 64 bits.
+ *
+ * x86 before AVX-512 has no vector conversions between 64-bit integers
+ * and doubles, so they are done with the usual trick: a double whose bits
+ * are 0x433 followed by the 52 bits of k (k < 2^52) is 2^52 + k, and one
+ * with 0x453 followed by k is 2^84 + 2^32 k. Adding 2^52 to the U
+ * estimate rounds it to the nearest integer rather than down, but it is
+ * corrected by one either way below, as in U, which is all it can need:
+ * the double is within 2^-20 of the true value. */
+
+union dbits {
+	double d;
+	uint64_t w;
+};
+
+#define TWO52 4503599627370496.0		/* 2^52 */
+#define TWO84 19342813113834066795298816.0	/* 2^84 */
+
+/* pack_block: z[i] = C(xy[2i],xy[2i+1]), i < n. Returns how many of
+ * the pairs are too big to unpack. */
+
+long pack_block(whole *restrict xy, whole *restrict z, long n){
+
+	long i, bad = 0;
+	whole x, y, s;
+
+	for(i=0;i<n;i++){
+		x = xy[2*i];
+		y = xy[2*i+1];
+		s = x + y;
+		z[i] = (s*s + s + 2*x)/2;
+		bad += (s < x) | (s > NMAX) | (s*s + s > TYPEMAX - 1 - 2*x);
+	}
+	return bad;
+}
+
+/* unpack_block: xy[2i] = head(z[i]), xy[2i+1] = tail(z[i]), i < n.
+ * Returns how many of the z[i] are too big to unpack. */
+
+long unpack_block(whole *restrict z, whole *restrict xy, long n){
+
+	long i, bad = 0;
+	whole m, e, h;
+	union dbits hi, lo, d;
+
+	for(i=0;i<n;i++){
+		m = 2*z[i];
+		hi.w = 0x4530000000000000ULL | ((uint64_t)m >> 32);
+		lo.w = 0x4330000000000000ULL | ((uint64_t)m & 0xffffffff);
+		d.d = (hi.d - TWO84) + (lo.d - TWO52);	/* m as a double */
+		d.d = (sqrt(4.0*d.d + 1.0) - 1.0)/2.0 + TWO52;
+		e = (whole)(d.w - 0x4330000000000000ULL);
+		e = e < NMAX ? e : NMAX;
+		e -= e*e + e > m;
+		e += (e < NMAX) & (e*e + 3*e + 2 <= m);
+		h = (m - e*e - e)/2;
+		xy[2*i] = h;
+		xy[2*i+1] = e - h;
+		bad += z[i] > TYPEMAX/2;
+	}
+	return bad;
+}
+
+/* splitmix64, for random test values */
+
+static uint64_t mix(uint64_t *s)
+{
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Stuff for -check. */
+
+/* Compare U_sqrt with U_bisect at z, and the unpacking of z, if it is
+ * small enough to unpack, with pack. Returns the number of failures (0 or
+ * 1). */
+
+static int check1(whole z)
+{
+	whole x, y, xy[2], z2;
+
+	if(U_sqrt(z) != U_bisect(z)){
+		fprintf(stderr,"pack: U(%"PRINT_AS") = %"PRINT_AS", bisection gives %"PRINT_AS"\n",
+			z,U_sqrt(z),U_bisect(z));
+		return 1;
+	}
+	if(z <= TYPEMAX/2){
+		unpack(z,&x,&y);
+		if(pack(x,y) != z || x != head(z) || y != tail(z)){
+			fprintf(stderr,"pack: %"PRINT_AS" does not unpack\n",z);
+			return 1;
+		}
+		unpack_block(&z,xy,1);
+		pack_block(xy,&z2,1);
+		if(xy[0] != x || xy[1] != y || z2 != z){
+			fprintf(stderr,"pack: block kernels disagree at %"PRINT_AS"\n",z);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* check: check U_sqrt at the ends of its range, around V(n) for small n
+ * and for n near NMAX, and at n random numbers of all sizes, and that the
+ * slow methods agree with it for small z. Unpacking is checked with
+ * U_sqrt, whatever -u says. Returns the number of failures. */
+
+static long check(long n)
+{
+	long i, bad = 0;
+	whole k, v;
+	uint64_t s = 1;
+	int d;
+
+	U = U_sqrt;
+	for(v=0;v<5000;v++)
+		for(d=0;d<NMETHODS;d++)
+			if(methods[d].U(v) != U_sqrt(v)){
+				fprintf(stderr,"pack: U(%"PRINT_AS") is wrong with %s\n",
+					v,methods[d].name);
+				bad++;
+			}
+	for(d=0;d<4;d++){
+		bad += check1((whole)d);
+		bad += check1(TYPEMAX-d);
+		bad += check1(TYPEMAX/2-d);
+		bad += check1(TYPEMAX/2+d);
+	}
+	for(i=0;i<2000;i++){
+		k = i < 1000 ? (whole)i : NMAX - (whole)(i-1000);
+		v = V(k);
+		bad += check1(v);
+		bad += check1(v+1);
+		if(v > 0)
+			bad += check1(v-1);
+		if(k < NMAX)
+			bad += check1(V(k+1)-1);
+	}
+	for(i=0;i<n;i++)
+		bad += check1((whole)(mix(&s) >> (mix(&s) % 64)));
+	return bad;
+}
+
+
+/* Stuff for -m 128. With a compiler that has unsigned __int128 (gcc and
+ * clang on 64-bit machines), x and y are 64-bit and z is 128-bit. As in the
+ * default mode, 2z must not overflow, so the codes run up to 2^127 - 1;
+ * every pair with x + y < 2^64 - 1 fits, and some others. (No pair of
+ * 64-bit numbers can need more: the largest, C(2^64-1,2^64-1), is about
+ * 2^129. Use -m big for those.) */
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 whole128;
+
+#define NMAX128 ((whole128)UINT64_MAX)
+#define LIM128 (~(whole128)0 - 1)	/* 2(2^127 - 1), the largest 2z */
+
+/* pack128: set *z = C(x,y); return -1 if it is too big, else 0 */
+
+int pack128(uint64_t x, uint64_t y, whole128 *z){
+
+	whole128 s = (whole128)x + y;
+
+	if(s > NMAX128 || s*s + s > LIM128 - 2*(whole128)x)
+		return -1;
+	*z = (s*s + s + 2*(whole128)x)/2;
+	return 0;
+}
+
+/* isqrt128: the integer square root of z, which is below 2^64. The double
+ * sqrt is within a relative 2^-52 of it, one Newton step (which never
+ * leaves r below the root) makes that an error of a unit or so, and
+ * exact arithmetic does the rest. */
+
+static whole128 isqrt128(whole128 z){
+
+	double d = sqrt((double)z);
+	whole128 r = d >= 18446744073709551615.0 ? NMAX128 : (whole128)d;
+
+	if(r > 0){
+		r = (r + z/r)/2;
+		if(r > NMAX128)
+			r = NMAX128;
+	}
+	while(r*r > z)
+		r--;
+	while(r < NMAX128 && (r+1)*(r+1) <= z)
+		r++;
+	return r;
+}
+
+/* U128: U for 128-bit z. With r = isqrt(z), V(r-1) = r^2 - r <= z, so
+ * U(z) is r or r - 1. */
+
+whole128 U128(whole128 z){
+
+	whole128 r = isqrt128(z);
+
+	return r*r + r > z ? r - 1 : r;
+}
+
+/* unpack128: unpack z, which must be at most 2^127 - 1 */
+
+void unpack128(whole128 z, uint64_t *x, uint64_t *y){
+
+	whole128 n = U128(2*z), h = (2*z - n*n - n)/2;
+
+	*x = (uint64_t)h;
+	*y = (uint64_t)(n - h);
+}
+
+/* Read a 128-bit number from s, or return -1 if it is not one */
+
+static int read128(char *s, whole128 *z){
+
+	whole128 v = 0;
+
+	if(*s == '\0')
+		return -1;
+	for(;*s;s++){
+		if(*s < '0' || *s > '9' || v > (~(whole128)0 - (*s - '0'))/10)
+			return -1;
+		v = 10*v + (*s - '0');
+	}
+	*z = v;
+	return 0;
+}
+
+/* Print a 128-bit number in decimal */
+
+static void print128(whole128 z){
+
+	char buf[48], *p = buf + sizeof(buf);
+
+	*--p = '\0';
+	do {
+		*--p = '0' + (int)(z % 10);
+		z /= 10;
+	} while(z);
+	fputs(p,stdout);
+}
+#endif
+
+/* Stuff for -m big: unsigned integers of any size, as arrays of n 32-bit
+ * limbs, least significant first, with d[n-1] != 0 (n = 0 for zero). With
+ * these, pairs and tuples of any size pack without loss. Everything is
+ * done with additions, subtractions, shifts and multiplications; U uses
+ * U(m) = floor((isqrt(4m+1) - 1)/2), since n^2 + n <= m exactly when
+ * (2n+1)^2 <= 4m+1, and the square root is found bit by bit. */
+
+struct big {
+	int n, cap;
+	uint32_t *d;
+};
+
+/* Make room for n limbs in a */
+
+static void big_fit(struct big *a, int n){
+
+	if(n <= a->cap)
+		return;
+	a->cap = 2*n;
+	if((a->d = realloc(a->d,a->cap*sizeof(uint32_t))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+}
+
+static void big_norm(struct big *a){
+
+	while(a->n && a->d[a->n-1] == 0)
+		a->n--;
+}
+
+static void big_set(struct big *a, uint64_t v){
+
+	big_fit(a,2);
+	a->d[0] = (uint32_t)v;
+	a->d[1] = (uint32_t)(v >> 32);
+	a->n = 2;
+	big_norm(a);
+}
+
+static void big_copy(struct big *r, struct big *a){
+
+	big_fit(r,a->n);
+	memcpy(r->d,a->d,a->n*sizeof(uint32_t));
+	r->n = a->n;
+}
+
+static int big_cmp(struct big *a, struct big *b){
+
+	int i;
+
+	if(a->n != b->n)
+		return a->n < b->n ? -1 : 1;
+	for(i=a->n-1;i>=0;i--)
+		if(a->d[i] != b->d[i])
+			return a->d[i] < b->d[i] ? -1 : 1;
+	return 0;
+}
+
+/* r = a + b. r may be a or b. */
+
+static void big_add(struct big *r, struct big *a, struct big *b){
+
+	int i, n = a->n > b->n ? a->n : b->n;
+	uint64_t t = 0;
+
+	big_fit(r,n+1);
+	for(i=0;i<n;i++){
+		t += (uint64_t)(i < a->n ? a->d[i] : 0) + (i < b->n ? b->d[i] : 0);
+		r->d[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	r->d[n] = (uint32_t)t;
+	r->n = n+1;
+	big_norm(r);
+}
+
+/* r = a - b, where a >= b. r may be a or b. */
+
+static void big_sub(struct big *r, struct big *a, struct big *b){
+
+	int i, n = a->n;
+	int64_t t = 0;
+
+	big_fit(r,n);
+	for(i=0;i<n;i++){
+		t += (int64_t)a->d[i] - (i < b->n ? b->d[i] : 0);
+		r->d[i] = (uint32_t)t;
+		t = t < 0 ? -1 : 0;
+	}
+	r->n = n;
+	big_norm(r);
+}
+
+/* r = a*b. r must not be a or b. */
+
+static void big_mul(struct big *r, struct big *a, struct big *b){
+
+	int i, j;
+	uint64_t t;
+
+	big_fit(r,a->n+b->n);
+	memset(r->d,0,(a->n+b->n)*sizeof(uint32_t));
+	for(i=0;i<a->n;i++){
+		t = 0;
+		for(j=0;j<b->n;j++){
+			t += (uint64_t)a->d[i]*b->d[j] + r->d[i+j];
+			r->d[i+j] = (uint32_t)t;
+			t >>= 32;
+		}
+		r->d[i+b->n] = (uint32_t)t;
+	}
+	r->n = a->n+b->n;
+	big_norm(r);
+}
+
+/* a = a*2^k or a/2^k (rounded down), 0 <= k < 32 */
+
+static void big_shl(struct big *a, int k){
+
+	int i;
+
+	if(k == 0 || a->n == 0)
+		return;
+	big_fit(a,a->n+1);
+	a->d[a->n] = 0;
+	for(i=a->n;i>0;i--)
+		a->d[i] = (a->d[i] << k) | (a->d[i-1] >> (32-k));
+	a->d[0] <<= k;
+	a->n++;
+	big_norm(a);
+}
+
+static void big_shr(struct big *a, int k){
+
+	int i;
+
+	if(k == 0 || a->n == 0)
+		return;
+	for(i=0;i<a->n-1;i++)
+		a->d[i] = (a->d[i] >> k) | (a->d[i+1] << (32-k));
+	a->d[a->n-1] >>= k;
+	big_norm(a);
+}
+
+/* a = a + v, for a small v */
+
+static void big_addsmall(struct big *a, uint32_t v){
+
+	int i;
+	uint64_t t = v;
+
+	big_fit(a,a->n+1);
+	a->d[a->n] = 0;
+	for(i=0;t && i<=a->n;i++){
+		t += a->d[i];
+		a->d[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	a->n++;
+	big_norm(a);
+}
+
+/* r = isqrt(a), by the bit by bit method: bit runs down through the
+ * powers of 4, and r + bit is subtracted from what is left whenever it
+ * fits. */
+
+static void big_isqrt(struct big *r, struct big *a){
+
+	static struct big rem, bit, t;
+	uint32_t top;
+	int b;
+
+	big_copy(&rem,a);
+	r->n = 0;
+	if(a->n == 0)
+		return;
+	b = 32*(a->n-1);
+	for(top=a->d[a->n-1];top>1;top>>=1)
+		b++;
+	b &= ~1;	/* the highest power of 4 <= a is 2^b */
+	big_fit(&bit,b/32+1);
+	memset(bit.d,0,(b/32+1)*sizeof(uint32_t));
+	bit.d[b/32] = (uint32_t)1 << (b%32);
+	bit.n = b/32+1;
+	while(bit.n){
+		big_add(&t,r,&bit);
+		big_shr(r,1);
+		if(big_cmp(&rem,&t) >= 0){
+			big_sub(&rem,&rem,&t);
+			big_add(r,r,&bit);
+		}
+		big_shr(&bit,2);
+	}
+}
+
+/* pack_big: z = C(x,y) = (s^2 + s + 2x)/2, s = x + y. z must not be x or
+ * y. */
+
+void pack_big(struct big *z, struct big *x, struct big *y){
+
+	static struct big s, t;
+
+	big_add(&s,x,y);
+	big_mul(z,&s,&s);
+	big_add(z,z,&s);
+	big_copy(&t,x);
+	big_shl(&t,1);
+	big_add(z,z,&t);
+	big_shr(z,1);
+}
+
+/* unpack_big: x = head(z), y = tail(z). x, y and z must all differ. */
+
+void unpack_big(struct big *z, struct big *x, struct big *y){
+
+	static struct big m, q, n, v, one;
+
+	big_copy(&m,z);
+	big_shl(&m,1);		/* m = 2z */
+	big_copy(&q,&m);
+	big_shl(&q,2);
+	big_addsmall(&q,1);	/* q = 4m + 1 */
+	big_isqrt(&n,&q);
+	big_set(&one,1);
+	big_sub(&n,&n,&one);
+	big_shr(&n,1);		/* n = U(m) */
+	big_mul(&v,&n,&n);
+	big_add(&v,&v,&n);
+	big_sub(x,&m,&v);
+	big_shr(x,1);
+	big_sub(y,&n,x);
+}
+
+/* Read a decimal number from s into a; return -1 if s is not one */
+
+static int big_read(struct big *a, char *s){
+
+	static struct big ten, t, dig;
+
+	if(*s == '\0')
+		return -1;
+	big_set(&ten,10);
+	a->n = 0;
+	for(;*s;s++){
+		if(*s < '0' || *s > '9')
+			return -1;
+		big_mul(&t,a,&ten);
+		big_set(&dig,(uint64_t)(*s - '0'));
+		big_add(a,&t,&dig);
+	}
+	return 0;
+}
+
+/* Print a in decimal, by dividing by 10^9 repeatedly */
+
+static void big_print(struct big *a){
+
+	static struct big t;
+	uint32_t *chunk;
+	uint64_t r;
+	int i, k = 0;
+
+	big_copy(&t,a);
+	if((chunk = malloc((t.n+1)*2*sizeof(uint32_t))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+	do {
+		r = 0;
+		for(i=t.n-1;i>=0;i--){
+			r = (r << 32) | t.d[i];
+			t.d[i] = (uint32_t)(r / 1000000000);
+			r %= 1000000000;
+		}
+		big_norm(&t);
+		chunk[k++] = (uint32_t)r;
+	} while(t.n);
+	printf("%u",chunk[--k]);
+	while(k > 0)
+		printf("%09u",chunk[--k]);
+	free(chunk);
+}
+
+/* Other pairings, and tuples.
+ *
+ * C is not the only packing function. Szudzik's
+ *
+ *        S(x,y) = y^2 + x      if x < y
+ *               = x^2 + x + y  otherwise
+ *
+ * also maps WxW onto W: the pairs with max(x,y) = m go, in order, to
+ * m^2, ..., m^2 + 2m = (m+1)^2 - 1. With s = isqrt(z) and r = z - s^2,
+ * S^-1(z) = (r,s) if r < s and (s,r-s) otherwise. C orders pairs by x + y
+ * and S by max(x,y), so S(x,y) < (max(x,y)+1)^2 while C(x,y) can be nearly
+ * 2 max(x,y)^2: S keys are up to a bit shorter, most of all for x near y.
+ *
+ * Tuples are packed by pairing repeatedly, either iterated from the right,
+ *
+ *        (x1,x2,...,xk) -> P(x1,P(x2,...P(x(k-1),xk)...)),
+ *
+ * or as a balanced tree, P(first half, second half), halves packed the
+ * same way. Since P roughly squares the larger of its arguments, iterated
+ * keys have about 2^(k-1) times as many bits as one value, and tree keys
+ * about k times as many: for more than two values use the tree. */
+
+/* isqrt for whole numbers, as U is done: a floating point guess corrected
+ * with exact arithmetic. The result is at most NMAX. */
+
+static whole isqrt_whole(whole z){
+
+	double d = sqrt((double)z);
+	whole s = d < (double)NMAX ? (whole)d : NMAX;
+
+	while(s*s > z)
+		s--;
+	while(s < NMAX && (s+1)*(s+1) <= z)
+		s++;
+	return s;
+}
+
+/* The pairing functions for whole numbers set *z to P(x,y) and return
+ * nonzero if it is too big to unpack. */
+
+static int pair_cantor(whole x, whole y, whole *z){
+
+	whole s = x + y;
+
+	*z = pack(x,y);
+	return s < x || s > NMAX || s*s + s > TYPEMAX - 1 - 2*x;
+}
+
+static int pair_szudzik(whole x, whole y, whole *z){
+
+	*z = x < y ? y*y + x : x*x + x + y;
+	return x > NMAX || y > NMAX;
+}
+
+static void unpair_szudzik(whole z, whole *x, whole *y){
+
+	whole s = isqrt_whole(z), r = z - s*s;
+
+	if(r < s){
+		*x = r;
+		*y = s;
+	}
+	else {
+		*x = s;
+		*y = r - s;
+	}
+}
+
+/* S for big integers. z must not be x or y. */
+
+static void pair_szudzik_big(struct big *z, struct big *x, struct big *y){
+
+	if(big_cmp(x,y) < 0){
+		big_mul(z,y,y);
+		big_add(z,z,x);
+	}
+	else {
+		big_mul(z,x,x);
+		big_add(z,z,x);
+		big_add(z,z,y);
+	}
+}
+
+static void unpair_szudzik_big(struct big *z, struct big *x, struct big *y){
+
+	static struct big s, r;
+
+	big_isqrt(&s,z);
+	big_mul(&r,&s,&s);
+	big_sub(&r,z,&r);
+	if(big_cmp(&r,&s) < 0){
+		big_copy(x,&r);
+		big_copy(y,&s);
+	}
+	else {
+		big_copy(x,&s);
+		big_sub(y,&r,&s);
+	}
+}
+
+struct pairing {
+	char *name;
+	whole zmax;		/* largest z that unpacks */
+	int (*pair)(whole x, whole y, whole *z);
+	void (*unpair)(whole z, whole *x, whole *y);
+	void (*pair_big)(struct big *z, struct big *x, struct big *y);
+	void (*unpair_big)(struct big *z, struct big *x, struct big *y);
+};
+
+struct pairing pairings[] = {
+	{"cantor", TYPEMAX/2, pair_cantor, unpack, pack_big, unpack_big},
+	{"szudzik", TYPEMAX, pair_szudzik, unpair_szudzik, pair_szudzik_big,
+		unpair_szudzik_big},
+};
+
+#define NPAIRINGS (int)(sizeof(pairings)/sizeof(pairings[0]))
+
+/* Where a tuple of k > 1 values is split in two: after the first value
+ * when iterated, in the middle for a tree. */
+
+#define SPLIT(k,tree) ((tree) ? ((k)+1)/2 : 1)
+
+/* pack_tuple: *z = the packing of v[0], ..., v[k-1], k >= 1. Returns
+ * nonzero if it is too big to unpack. */
+
+static int pack_tuple(struct pairing *p, int tree, whole *v, int k, whole *z){
+
+	whole a, b;
+	int h = SPLIT(k,tree), bad;
+
+	if(k == 1){
+		*z = v[0];
+		return 0;
+	}
+	bad = pack_tuple(p,tree,v,h,&a);
+	bad |= pack_tuple(p,tree,v+h,k-h,&b);
+	return bad | p->pair(a,b,z);
+}
+
+static void unpack_tuple(struct pairing *p, int tree, whole z, whole *v,
+	int k){
+
+	whole a, b;
+	int h = SPLIT(k,tree);
+
+	if(k == 1){
+		v[0] = z;
+		return;
+	}
+	p->unpair(z,&a,&b);
+	unpack_tuple(p,tree,a,v,h);
+	unpack_tuple(p,tree,b,v+h,k-h);
+}
+
+/* The same for big integers. z must not be one of the v[i]. */
+
+static void pack_tuple_big(struct pairing *p, int tree, struct big *v, int k,
+	struct big *z){
+
+	struct big a, b;
+	int h = SPLIT(k,tree);
+
+	if(k == 1){
+		big_copy(z,&v[0]);
+		return;
+	}
+	memset(&a,0,sizeof(a));
+	memset(&b,0,sizeof(b));
+	pack_tuple_big(p,tree,v,h,&a);
+	pack_tuple_big(p,tree,v+h,k-h,&b);
+	p->pair_big(z,&a,&b);
+	free(a.d);
+	free(b.d);
+}
+
+static void unpack_tuple_big(struct pairing *p, int tree, struct big *z,
+	struct big *v, int k){
+
+	struct big a, b;
+	int h = SPLIT(k,tree);
+
+	if(k == 1){
+		big_copy(&v[0],z);
+		return;
+	}
+	memset(&a,0,sizeof(a));
+	memset(&b,0,sizeof(b));
+	p->unpair_big(z,&a,&b);
+	unpack_tuple_big(p,tree,&a,v,h);
+	unpack_tuple_big(p,tree,&b,v+h,k-h);
+	free(a.d);
+	free(b.d);
+}
+
+/* Number of bits in a */
+
+static int big_bits(struct big *a){
+
+	int b;
+	uint32_t top;
+
+	if(a->n == 0)
+		return 0;
+	b = 32*(a->n-1);
+	for(top=a->d[a->n-1];top;top>>=1)
+		b++;
+	return b;
+}
+
+/* read_whole: read the decimal number s into *v. Returns 0, or -1 if s is
+ * not a plain whole number or is too big for a whole. (atoll and friends
+ * saturate at the largest signed value, and take signs and junk.) */
+
+static int read_whole(char *s, whole *v){
+
+	unsigned long long t;
+	char *e;
+
+	if(*s < '0' || *s > '9')
+		return -1;
+	errno = 0;
+	t = strtoull(s,&e,10);
+	if(*e || errno == ERANGE || t > TYPEMAX)
+		return -1;
+	*v = (whole)t;
+	return 0;
+}
+
+/* check_szudzik: check S and its inverse on keys above TYPEMAX/2 (above
+ * 2^63 with 64-bit wholes), which C cannot reach, up to TYPEMAX itself,
+ * and that TYPEMAX reads back from the command line. Returns the number of
+ * failures. */
+
+static long check_szudzik(void)
+{
+	long bad = 0;
+	whole x, y, z, x2, y2;
+	char buf[24];
+	uint64_t s = 1;
+	int i;
+
+	for(i=0;i<1016;i++){
+		if(i < 16){
+			x = NMAX - (whole)(i/4);
+			y = NMAX - (whole)(i%4);
+		}
+		else {
+			/* both at least NMAX/sqrt(2), so the key is above TYPEMAX/2 */
+			x = NMAX - (whole)(mix(&s) % (NMAX/4));
+			y = NMAX - (whole)(mix(&s) % (NMAX/4));
+		}
+		if(pair_szudzik(x,y,&z) || z <= TYPEMAX/2){
+			fprintf(stderr,"pack: S(%"PRINT_AS",%"PRINT_AS") is out of range\n",x,y);
+			bad++;
+			continue;
+		}
+		unpair_szudzik(z,&x2,&y2);
+		if(x2 != x || y2 != y){
+			fprintf(stderr,"pack: S key %"PRINT_AS" does not unpair\n",z);
+			bad++;
+		}
+	}
+	sprintf(buf,"%"PRINT_AS,(whole)TYPEMAX);
+	if(read_whole(buf,&z) || z != TYPEMAX){
+		fprintf(stderr,"pack: %s does not read back\n",buf);
+		bad++;
+	}
+	unpair_szudzik(TYPEMAX,&x,&y);
+	if(x != NMAX || y != NMAX){
+		fprintf(stderr,"pack: S key %"PRINT_AS" does not unpair\n",(whole)TYPEMAX);
+		bad++;
+	}
+	return bad;
+}
+
+/* tuple_main: pack the numbers in args, or unpack zarg into k numbers, as
+ * whole numbers with pairing p. */
+
+static int tuple_main(struct pairing *p, int tree, char *zarg, int k,
+	int nargs, char **args){
+
+	whole *v, z;
+	int i;
+
+	if(zarg != NULL)
+		nargs = k;
+	if(nargs < 1){
+		fprintf(stderr,"%s\n",USAGE);
+		return 1;
+	}
+	if((v = malloc(nargs*sizeof(whole))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		return 1;
+	}
+	if(zarg != NULL){
+		if(read_whole(zarg,&z)){
+			fprintf(stderr,"pack: %s is not a whole number\n",zarg);
+			free(v);
+			return 1;
+		}
+		if(z > p->zmax)
+			fprintf(stderr,"pack: value is too big. May not unpack correctly.\n");
+		unpack_tuple(p,tree,z,v,k);
+		for(i=0;i<k;i++)
+			printf("%"PRINT_AS"%s",v[i],i+1 < k ? " " : "\n");
+		free(v);
+		return 0;
+	}
+	for(i=0;i<nargs;i++)
+		if(read_whole(args[i],&v[i])){
+			fprintf(stderr,"pack: %s is not a whole number\n",args[i]);
+			free(v);
+			return 1;
+		}
+	if(pack_tuple(p,tree,v,nargs,&z))
+		fprintf(stderr,"pack: warning: values are too big! Will not unpack correctly. Try -m big.\n");
+	printf("%"PRINT_AS"\n",z);
+	free(v);
+	return 0;
+}
+
+#ifdef __SIZEOF_INT128__
+/* wide_main: pack the two numbers in args, or unpack zarg, in 128 bits */
+
+static int wide_main(char *zarg, int nargs, char **args){
+
+	whole128 z;
+	uint64_t x, y;
+	char *e1, *e2;
+
+	if(zarg != NULL){
+		if(read128(zarg,&z) || z > (~(whole128)0)/2){
+			fprintf(stderr,"pack: %s is not a number below 2^127\n",zarg);
+			return 1;
+		}
+		unpack128(z,&x,&y);
+		printf("%llu %llu\n",(unsigned long long)x,(unsigned long long)y);
+		return 0;
+	}
+	if(nargs != 2){
+		fprintf(stderr,"%s\n",USAGE);
+		return 1;
+	}
+	x = strtoull(args[0],&e1,10);
+	y = strtoull(args[1],&e2,10);
+	if(*e1 || *e2 || args[0][0] == '-' || args[1][0] == '-'){
+		fprintf(stderr,"pack: x and y must be 64-bit whole numbers\n");
+		return 1;
+	}
+	if(pack128(x,y,&z)){
+		fprintf(stderr,"pack: x + y is too big for -m 128. Use -m big.\n");
+		return 1;
+	}
+	print128(z);
+	printf("\n");
+	return 0;
+}
+#endif
+
+/* big_main: pack the numbers in args, or unpack zarg into k numbers, with
+ * big integers and pairing p. */
+
+static int big_main(struct pairing *p, int tree, char *zarg, int k,
+	int nargs, char **args){
+
+	struct big z, *v;
+	int i;
+
+	if(zarg != NULL)
+		nargs = k;
+	if(nargs < 1){
+		fprintf(stderr,"%s\n",USAGE);
+		return 1;
+	}
+	memset(&z,0,sizeof(z));
+	if((v = calloc(nargs,sizeof(struct big))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		return 1;
+	}
+	if(zarg != NULL){
+		if(big_read(&z,zarg)){
+			fprintf(stderr,"pack: %s is not a whole number\n",zarg);
+			return 1;
+		}
+		unpack_tuple_big(p,tree,&z,v,k);
+		for(i=0;i<k;i++){
+			big_print(&v[i]);
+			printf(i+1 < k ? " " : "\n");
+		}
+		return 0;
+	}
+	for(i=0;i<nargs;i++)
+		if(big_read(&v[i],args[i])){
+			fprintf(stderr,"pack: %s is not a whole number\n",args[i]);
+			return 1;
+		}
+	pack_tuple_big(p,tree,v,nargs,&z);
+	big_print(&z);
+	printf("\n");
+	return 0;
+}
+
+/* Stuff for -stream: pack the pairs of numbers read from stdin, or with
+ * -1 unpack the numbers read, and write the results to stdout, BLOCK at a
+ * time through the kernels above. With -f bin, input and output are
+ * arrays of whole in the machine's own format (x y x y ... or z z ...);
+ * otherwise they are decimal text, one pair or number per line on output
+ * and separated by any white space on input. The text is read and
+ * written through large buffers by the routines below, rather than with
+ * scanf and printf, which would take most of the time. */
+
+#define BLOCK 4096
+#define IOBUF (1<<16)
+
+struct in {
+	FILE *f;
+	char buf[IOBUF], *p, *end;
+};
+
+/* read_num: read the next number from in into *v. Returns 1 if there was
+ * one, 0 at end of file, and -1 if something else was found or the number
+ * does not fit in a whole. */
+
+static int read_num(struct in *in, whole *v){
+
+	int c, got = 0;
+	whole t = 0;
+
+	for(;;){
+		if(in->p == in->end){
+			in->end = in->buf + fread(in->buf,1,IOBUF,in->f);
+			in->p = in->buf;
+			if(in->p == in->end)
+				break;
+		}
+		c = *in->p;
+		if(c >= '0' && c <= '9'){
+			if(t > (TYPEMAX - (c - '0'))/10)
+				return -1;	/* too big for whole */
+			t = 10*t + (c - '0');
+			got = 1;
+		}
+		else if(c == ' ' || c == '\n' || c == '\t' || c == '\r'){
+			if(got)
+				break;
+		}
+		else
+			return -1;
+		in->p++;
+	}
+	*v = t;
+	return got;
+}
+
+/* put_num: write v in decimal, followed by the character c, at p, and
+ * return the end */
+
+static char *put_num(char *p, whole v, int c){
+
+	char tmp[24];
+	int k = 0;
+
+	do {
+		tmp[k++] = '0' + (int)(v % 10);
+		v /= 10;
+	} while(v);
+	while(k)
+		*p++ = tmp[--k];
+	*p++ = c;
+	return p;
+}
+
+static int stream(int unpacking, int binary){
+
+	static struct in in;
+	whole *ibuf, *obuf;
+	char *text, *p;
+	long n, i, want, nin, nout, bad = 0, count = 0;
+	int r = 1;
+	struct timespec t0, t1;
+	double secs;
+
+	want = unpacking ? BLOCK : 2*BLOCK;	/* values read per block */
+	ibuf = malloc(2*BLOCK*sizeof(whole));
+	obuf = malloc(2*BLOCK*sizeof(whole));
+	text = malloc(2*BLOCK*24);
+	if(ibuf == NULL || obuf == NULL || text == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		return 1;
+	}
+	in.f = stdin;
+	in.p = in.end = in.buf;
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+
+	for(;;){
+		if(binary)
+			n = fread(ibuf,sizeof(whole),want,stdin);
+		else
+			for(n=0;n<want && (r = read_num(&in,&ibuf[n])) == 1;n++)
+				;
+		if(r < 0){
+			fprintf(stderr,"pack: bad input\n");
+			return 1;
+		}
+		if(n == 0)
+			break;
+		if(!unpacking && n % 2){
+			fprintf(stderr,"pack: odd number of values\n");
+			return 1;
+		}
+		if(unpacking){
+			nin = n;
+			nout = 2*n;
+			bad += unpack_block(ibuf,obuf,nin);
+		}
+		else {
+			nin = n/2;
+			nout = n/2;
+			bad += pack_block(ibuf,obuf,nin);
+		}
+		count += nin;
+		if(binary)
+			fwrite(obuf,sizeof(whole),nout,stdout);
+		else {
+			p = text;
+			for(i=0;i<nout;i++)
+				p = put_num(p,obuf[i],
+					unpacking && i % 2 == 0 ? ' ' : '\n');
+			fwrite(text,1,p-text,stdout);
+		}
+		if(n < want)
+			break;
+	}
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	secs = (t1.tv_sec-t0.tv_sec) + 1e-9*(t1.tv_nsec-t0.tv_nsec);
+
+	if(bad)
+		fprintf(stderr,"pack: warning: %ld %s too big! Will not unpack correctly.\n",
+			bad,unpacking ? "values" : "pairs");
+	fprintf(stderr,"%ld %s in %.3f s: %.1f million per second\n",count,
+		unpacking ? "values unpacked" : "pairs packed",secs,
+		secs > 0 ? count/secs/1e6 : 0.0);
+	free(ibuf);
+	free(obuf);
+	free(text);
+	return ferror(stdout) ? 1 : 0;
+}
+
+/* Stuff for -bench: time packing and unpacking n random pairs in each
+ * mode, with x and y of the given number of bits, and check that they
+ * round trip. */
+
+static double now(void){
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+static void bench_line(char *mode, int bits, long n, double tp, double tu,
+	long bad){
+
+	printf("%-8s %6d %12.1f %12.1f %12.2f %12.2f %s\n",mode,bits,
+		1e9*tp/n,1e9*tu/n,n/tp/1e6,n/tu/1e6,bad ? "FAILED" : "ok");
+}
+
+static void bench_whole(long n){
+
+	whole *xs, *ys, *zs, x, y;
+	uint64_t s = 1;
+	int bits = sizeof(whole)*CHAR_BIT/2 - 1;
+	long i, bad = 0;
+	double t0, t1, t2;
+
+	xs = malloc(2*n*sizeof(whole));
+	zs = malloc(n*sizeof(whole));
+	if(xs == NULL || zs == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+	for(i=0;i<2*n;i++)
+		xs[i] = (whole)(mix(&s) >> (64 - bits));
+	t0 = now();
+	for(i=0;i<n;i++)
+		zs[i] = pack(xs[2*i],xs[2*i+1]);
+	t1 = now();
+	for(i=0;i<n;i++){
+		unpack(zs[i],&x,&y);
+		bad += x != xs[2*i] || y != xs[2*i+1];
+	}
+	t2 = now();
+	bench_line("whole",bits,n,t1-t0,t2-t1,bad);
+
+	/* the same, BLOCK at a time through the -stream kernels */
+
+	if((ys = malloc(2*n*sizeof(whole))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+
+	/* one pass untimed first: the first pass over new memory runs at
+	 * half speed or worse, and so would the first vector loops on
+	 * machines that change clock for the wider instructions */
+
+	for(i=0;i<n;i+=BLOCK){
+		pack_block(xs+2*i,zs+i,n-i < BLOCK ? n-i : BLOCK);
+		unpack_block(zs+i,ys+2*i,n-i < BLOCK ? n-i : BLOCK);
+	}
+	bad = 0;
+	t0 = now();
+	for(i=0;i<n;i+=BLOCK)
+		bad += pack_block(xs+2*i,zs+i,n-i < BLOCK ? n-i : BLOCK);
+	t1 = now();
+	for(i=0;i<n;i+=BLOCK)
+		bad += unpack_block(zs+i,ys+2*i,n-i < BLOCK ? n-i : BLOCK);
+	t2 = now();
+	for(i=0;i<2*n;i++)
+		bad += ys[i] != xs[i];
+	bench_line("block",bits,n,t1-t0,t2-t1,bad);
+	free(ys);
+	free(xs);
+	free(zs);
+}
+
+#ifdef __SIZEOF_INT128__
+static void bench_128(long n){
+
+	uint64_t *xs, x, y, s = 1;
+	whole128 *zs;
+	long i, bad = 0;
+	double t0, t1, t2;
+
+	xs = malloc(2*n*sizeof(uint64_t));
+	zs = malloc(n*sizeof(whole128));
+	if(xs == NULL || zs == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+	for(i=0;i<2*n;i++)
+		xs[i] = mix(&s) >> 1;
+	t0 = now();
+	for(i=0;i<n;i++)
+		bad += pack128(xs[2*i],xs[2*i+1],&zs[i]);
+	t1 = now();
+	for(i=0;i<n;i++){
+		unpack128(zs[i],&x,&y);
+		bad += x != xs[2*i] || y != xs[2*i+1];
+	}
+	t2 = now();
+	bench_line("128",63,n,t1-t0,t2-t1,bad);
+	free(xs);
+	free(zs);
+}
+#endif
+
+static void bench_big(long n, int limbs){
+
+	uint32_t *xs;
+	struct big *zs, x, y, a, b;
+	uint64_t s = 1;
+	long i, bad = 0;
+	double t0, t1, t2;
+
+	xs = malloc(2*n*limbs*sizeof(uint32_t));
+	zs = calloc(n,sizeof(struct big));
+	if(xs == NULL || zs == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+	for(i=0;i<2*n*limbs;i++)
+		xs[i] = (uint32_t)mix(&s);
+	memset(&x,0,sizeof(x));
+	memset(&y,0,sizeof(y));
+
+	/* a and b look at the numbers in xs, without copying them */
+
+	a.cap = b.cap = limbs;
+	t0 = now();
+	for(i=0;i<n;i++){
+		a.d = xs + 2*i*limbs;
+		b.d = a.d + limbs;
+		a.n = b.n = limbs;
+		big_norm(&a);
+		big_norm(&b);
+		pack_big(&zs[i],&a,&b);
+	}
+	t1 = now();
+	for(i=0;i<n;i++){
+		a.d = xs + 2*i*limbs;
+		b.d = a.d + limbs;
+		a.n = b.n = limbs;
+		big_norm(&a);
+		big_norm(&b);
+		unpack_big(&zs[i],&x,&y);
+		bad += big_cmp(&x,&a) || big_cmp(&y,&b);
+	}
+	t2 = now();
+	bench_line("big",32*limbs,n,t1-t0,t2-t1,bad);
+	for(i=0;i<n;i++)
+		free(zs[i].d);
+	free(zs);
+	free(xs);
+	free(x.d);
+	free(y.d);
+}
+
+/* Time head and tail with each U, for z of each number of decimal digits.
+ * Each time is for as many calls as take about a twentieth of a second,
+ * but at most n. A method is dropped once one call takes over a
+ * millisecond, since for the next size it would take about 3 (recursive)
+ * or 10 (primitive) times longer. U_primitive recurses 2z deep in head,
+ * and again in tail, so it is also dropped, and the stack it would need
+ * is reported, once that does not fit in the stack limit. */
+
+static void bench_methods(long n){
+
+	whole (*u)(whole z) = U;
+	whole *zs, lo, hi, zfit;
+	uint64_t s;
+	uintptr_t top = (uintptr_t)&s;
+	double t, ns, deepest = 0;
+	long i, calls;
+	int d, m, dropped[NMETHODS];
+
+	if((zs = malloc(n*sizeof(whole))) == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+
+	/* head and tail call U at 2z */
+
+	zfit = primitive_limit()/2;
+
+	printf("%-8s","digits");
+	for(m=0;m<NMETHODS;m++){
+		printf(" %12s",methods[m].name);
+		dropped[m] = 0;
+	}
+	printf("   (ns for head and tail)\n");
+	lo = 0;
+	for(d=1;lo <= TYPEMAX/2;d++){
+
+		/* z has d digits: lo <= z <= hi */
+
+		hi = lo == 0 ? 9 : (lo <= TYPEMAX/20 ? 10*lo - 1 : TYPEMAX/2);
+		s = 1;
+		for(i=0;i<n;i++)
+			zs[i] = lo + (whole)(mix(&s) % ((uint64_t)(hi - lo) + 1));
+		printf("%-8d",d);
+		for(m=0;m<NMETHODS;m++){
+			if(methods[m].U == U_primitive_safe && hi > zfit)
+				dropped[m] = 2;
+			if(dropped[m]){
+				printf(" %12s",dropped[m] == 2 ? "stack" : "-");
+				continue;
+			}
+			U = methods[m].U;
+			stack_low = UINTPTR_MAX;
+			for(calls=1;;calls*=2){
+				if(calls > n)
+					calls = n;
+				t = now();
+				for(i=0;i<calls;i++)
+					sink += head(zs[i]) + tail(zs[i]);
+				t = now() - t;
+				if(t > 0.05 || calls == n)
+					break;
+			}
+			ns = 1e9*t/calls;
+			printf(" %12.1f",ns);
+			if(ns > 1e6)
+				dropped[m] = 1;
+			if(U == U_primitive_safe && top - stack_low > deepest)
+				deepest = top - stack_low;
+		}
+		printf("\n");
+		if(hi == TYPEMAX/2)
+			break;
+		lo = hi + 1;
+	}
+	U = u;
+	printf("\nprimitive: %.0f bytes of stack per level; the deepest run above used %.0f kB.\n",
+		primitive_frame,deepest/1024);
+	if(zfit < TYPEMAX/2)
+		printf("z up to %"PRINT_AS" fits in the stack limit.\n",zfit);
+	else
+		printf("There is no stack limit.\n");
+	free(zs);
+}
+
+static void bench(long n){
+
+	whole (*u)(whole z) = U;
+
+	if(n < 1)
+		n = 1;
+	U = U_sqrt;
+	printf("%-8s %6s %12s %12s %12s %12s\n","mode","bits","pack ns",
+		"unpack ns","pack M/s","unpack M/s");
+	bench_whole(n);
+#ifdef __SIZEOF_INT128__
+	bench_128(n);
+#endif
+	bench_big((n + 15)/16,2);		/* big is slow: time fewer */
+	bench_big((n + 15)/16,8);
+	U = u;
+	printf("\n");
+	bench_methods(n);
+}
+
+/* Stuff for -lengths: pack n random k-tuples of b-bit values with each
+ * pairing, iterated and as a tree, in big integers, and print the mean and
+ * largest key sizes in bits, how much more that is than the k*b bits in
+ * the values, and how many keys would unpack as whole numbers. Each tuple
+ * is unpacked again to check it. The same tuples are used for every
+ * scheme. */
+
+static void big_random(struct big *a, int b, uint64_t *s){
+
+	int i;
+
+	big_fit(a,(b+31)/32);
+	a->n = (b+31)/32;
+	for(i=0;i<a->n;i++)
+		a->d[i] = (uint32_t)mix(s);
+	if(b%32)
+		a->d[a->n-1] &= ((uint32_t)1 << (b%32)) - 1;
+	big_norm(a);
+}
+
+static void lengths(long n, int k, int b){
+
+	struct big *v, *w, z, zmax;
+	struct pairing *p;
+	uint64_t s;
+	long r, fits, bad;
+	int i, tree, bits, max;
+	double sum;
+
+	v = calloc(k,sizeof(struct big));
+	w = calloc(k,sizeof(struct big));
+	if(v == NULL || w == NULL){
+		fprintf(stderr,"pack: out of memory\n");
+		exit(1);
+	}
+	memset(&z,0,sizeof(z));
+	memset(&zmax,0,sizeof(zmax));
+	if(n < 1)
+		n = 1;
+	printf("%ld tuples of %d values of %d bits (%d bits)\n\n",n,k,b,k*b);
+	printf("%-8s %-8s %10s %10s %10s %10s\n","pairing","tuple",
+		"mean bits","max bits","mean over","in whole");
+	for(p=pairings;p<pairings+NPAIRINGS;p++)
+		for(tree=0;tree<2;tree++){
+			big_set(&zmax,(uint64_t)p->zmax);
+			s = 1;
+			sum = 0;
+			max = 0;
+			fits = bad = 0;
+			for(r=0;r<n;r++){
+				for(i=0;i<k;i++)
+					big_random(&v[i],b,&s);
+				pack_tuple_big(p,tree,v,k,&z);
+				bits = big_bits(&z);
+				sum += bits;
+				if(bits > max)
+					max = bits;
+				fits += big_cmp(&z,&zmax) <= 0;
+				unpack_tuple_big(p,tree,&z,w,k);
+				for(i=0;i<k;i++)
+					bad += big_cmp(&v[i],&w[i]) != 0;
+			}
+			printf("%-8s %-8s %10.1f %10d %10.1f %9.1f%% %s\n",p->name,
+				tree ? "tree" : "iterated",sum/n,max,sum/n - k*b,
+				100.0*fits/n,bad ? "FAILED" : "ok");
+		}
+	for(i=0;i<k;i++){
+		free(v[i].d);
+		free(w[i].d);
+	}
+	free(v);
+	free(w);
+	free(z.d);
+	free(zmax.d);
+}
+
+/* Modes */
+#define WHOLE 0
+#define WIDE 1		/* -m 128 */
+#define BIG 2
+
 int
 main(int argc, char **argv)
 {
-	int j=0;
-	whole x,y,z,w,t;
+	int j=0, mode = WHOLE, k = 2, unpacking = 0, pairing = 0, tree = 0;
+	int width = 32, i;
+	long nlengths = 0;
+	char *zarg = NULL;
+	int streaming = 0, binary = 0;
+	whole x,y,z,t;
+	long nbad;
+	whole w;
 
 	/* Process command line */
 
@@ -223,12 +1815,135 @@ main(int argc, char **argv)
 		if(argv[j][0] == '-')
 			switch(argv[j][1]){ 
 				case '1':
-					z = (whole)CONVERT(argv[j+1]);
+					/* z is not needed with -stream */
+					unpacking = 1;
+					if(j+1 < argc && argv[j+1][0] != '-')
+						zarg = argv[++j];
+					continue;
+				case 's':
+					/* -stream */
+					streaming = 1;
+					continue;
+				case 'f':
+					/* store next arg as stream format */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
 					j++;
-					if(z > TYPEMAX/2)fprintf(stderr,"pack: value is too big. May not unpack correctly.\n");
-
-					printf("%"PRINT_AS" %"PRINT_AS"\n",head(z),tail(z));
+					if(strcmp(argv[j],"bin") == 0)
+						binary = 1;
+					else if(strcmp(argv[j],"text") == 0)
+						binary = 0;
+					else {
+						fprintf(stderr,"pack: unknown format %s\n",
+							argv[j]);
+						return 1;
+					}
+					continue;
+				case 'm':
+					/* store next arg as mode */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					if(strcmp(argv[j],"whole") == 0)
+						mode = WHOLE;
+					else if(strcmp(argv[j],"128") == 0)
+						mode = WIDE;
+					else if(strcmp(argv[j],"big") == 0)
+						mode = BIG;
+					else {
+						fprintf(stderr,"pack: unknown mode %s\n",
+							argv[j]);
+						return 1;
+					}
+#ifndef __SIZEOF_INT128__
+					if(mode == WIDE){
+						fprintf(stderr,"pack: no 128-bit integers with this compiler\n");
+						return 1;
+					}
+#endif
+					continue;
+				case 'p':
+					/* store next arg as pairing */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					for(pairing=0;pairing<NPAIRINGS;pairing++)
+						if(strcmp(argv[j],pairings[pairing].name) == 0)
+							break;
+					if(pairing == NPAIRINGS){
+						fprintf(stderr,"pack: unknown pairing %s\n",
+							argv[j]);
+						return 1;
+					}
+					continue;
+				case 'u':
+					/* store next arg as method for U */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					for(i=0;i<NMETHODS;i++)
+						if(strcmp(argv[j],methods[i].name) == 0)
+							break;
+					if(i == NMETHODS){
+						fprintf(stderr,"pack: unknown method %s\n",
+							argv[j]);
+						return 1;
+					}
+					U = methods[i].U;
+					continue;
+				case 't':
+					/* -tree */
+					tree = 1;
+					continue;
+				case 'l':
+					/* -lengths, done once all options are in */
+					if(j+1 >= argc || (nlengths = atol(argv[j+1])) < 1){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					continue;
+				case 'w':
+					/* bits in values for -lengths */
+					if(j+1 >= argc || (width = atoi(argv[j+1])) < 1){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					continue;
+				case 'k':
+					/* number of values for -1 */
+					if(j+1 >= argc || (k = atoi(argv[j+1])) < 1){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					j++;
+					continue;
+				case 'b':
+					/* -bench */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					bench(atol(argv[j+1]));
 					return 0;
+				case 'c':
+					/* -check */
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						return 1;
+					}
+					nbad = check(atol(argv[j+1])) + check_szudzik();
+					printf("%ld failures\n",nbad);
+					return nbad ? 1 : 0;
 				case 'v':
 				case 'V':
 					printf("%s\n",VERSION);
@@ -237,12 +1952,10 @@ main(int argc, char **argv)
 				case 'h':
 				case 'H':
 					printf("%s\n",HELP);
-#if !defined(RECURSIVE) && !defined(PRIMITIVE_RECURSIVE)
-					t = U(TYPEMAX);
+					t = U_sqrt(TYPEMAX);
 					w = TYPEMAX - V(t);
 					if(2*t > w)t = t-1;
 					printf("Maximum x + y = %"PRINT_AS".\n",t);
-#endif
 					printf("Maximum value handled by -1 option: z = %"PRINT_AS".\n\n",TYPEMAX/2);
 					return 0;
 
@@ -254,26 +1967,77 @@ main(int argc, char **argv)
 		else  break;
 	}
 
-	if(j < argc)
-		x = (whole)CONVERT(argv[j++]);
+	if(nlengths){
+		lengths(nlengths,k,width);
+		return 0;
+	}
+	if(streaming){
+		if(mode != WHOLE || j < argc || pairing || tree){
+			fprintf(stderr,"pack: -stream reads stdin, and packs pairs with C in whole mode only\n");
+			return 1;
+		}
+		return stream(unpacking,binary);
+	}
+	if(unpacking && zarg == NULL){
+		fprintf(stderr,"%s\n",USAGE);
+		return 1;
+	}
+	if(mode == BIG)
+		return big_main(&pairings[pairing],tree,zarg,k,argc-j,argv+j);
+#ifdef __SIZEOF_INT128__
+	if(mode == WIDE){
+		if(pairing || tree){
+			fprintf(stderr,"pack: -m 128 packs pairs with C only\n");
+			return 1;
+		}
+		return wide_main(zarg,argc-j,argv+j);
+	}
+#endif
+	if(pairing || (zarg != NULL ? k : argc-j) != 2)
+		return tuple_main(&pairings[pairing],tree,zarg,k,argc-j,argv+j);
+
+	if(zarg != NULL){
+		if(read_whole(zarg,&z)){
+			fprintf(stderr,"pack: %s is not a whole number\n",zarg);
+			return 1;
+		}
+		if(z > TYPEMAX/2)fprintf(stderr,"pack: value is too big. May not unpack correctly.\n");
+
+		unpack(z,&x,&y);
+		printf("%"PRINT_AS" %"PRINT_AS"\n",x,y);
+		return 0;
+	}
+
+	if(j < argc){
+		if(read_whole(argv[j],&x)){
+			fprintf(stderr,"pack: %s is not a whole number\n",argv[j]);
+			return 1;
+		}
+		j++;
+	}
 	else {
 		fprintf(stderr,"%s\n",USAGE);
 		exit(1);
 	}
-	if(j < argc)
-		y = (whole)CONVERT(argv[j++]);
+	if(j < argc){
+		if(read_whole(argv[j],&y)){
+			fprintf(stderr,"pack: %s is not a whole number\n",argv[j]);
+			return 1;
+		}
+		j++;
+	}
 	else {
 		fprintf(stderr,"%s\n",USAGE);
 		exit(1);
 	}
 
 	/* Check to make sure the arguments won't produce an encoding that's
-	 * too big. */
+	 * too big. This is done with U_sqrt whatever -u says: the slow methods
+	 * recurse or loop on the size of t, and can run out of stack. */
+	U = U_sqrt;
 	t = pack(x,y);
-#if !defined(RECURSIVE) && !defined(PRIMITIVE_RECURSIVE)
 	if((x != head(t))||(y != tail(t)))
-		fprintf(stderr,"pack: warning: x or y is too big! Will not unpack correctly.\n");
-#endif
+		fprintf(stderr,"pack: warning: x or y is too big! Will not unpack correctly. Try -m 128 or -m big.\n");
 			
 	printf("%"PRINT_AS"\n",t);
 	return 0;
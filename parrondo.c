@@ -6,12 +6,12 @@
         The gambler's fortune starts at 0.
 
 	The simple game: Toss a biased coin and win +1 with probability
-		S_WIN_PROB (defined below). Otherwise win -1; 
+		S_WIN_PROB (defined below, or set with -ps). Otherwise win -1; 
 
 	The complex game: If the player's fortune is divisible by 3, toss
-		the "bad coin" having win probability BAD_WIN_PROB.
+		the "bad coin" having win probability BAD_WIN_PROB (-pb).
 		If the player's fortune is not divisible by 3 toss the
-                "good coin" having win probability GOOD_WIN_PROB.
+                "good coin" having win probability GOOD_WIN_PROB (-pg).
 
 	A game ends when the accumlated fortune exceeds MAX_FORTUNE ( a "win" )
 	or dips below -MAX_FORTUNE ( a "loss .)  
@@ -26,24 +26,58 @@
         and a seed for the random number can be supplied on the command line.
         The -h option prints detailed help. 
 
+	With -sweep, the win probabilities and the chance of choosing the
+        complex game (-pc) can each be given as a range lo:hi:n of n evenly
+        spaced values. The program then simulates every point of the grid,
+        several points at once with -j, and writes a CSV table of the win
+        and loss rates and mean trial length at each point, one line per
+        point, in the order of the grid with -pg varying fastest.
+
+	Besides the counts, the program reports 95% confidence intervals for
+        the win and loss probabilities (Wilson's score interval), and the
+        mean and standard deviation of the trial length and final fortune,
+        accumulated by Welford's method as blocks of trials finish. With
+        -w, it stops as soon as both intervals are narrower than a given
+        width, which saves most of the work for points of a sweep whose
+        rates are near 0 or 1.
+
+	The fortune is a birth-death Markov chain on -MAX_FORTUNE ...
+        MAX_FORTUNE: each play moves it up with a probability depending only
+        on the current fortune. With -exact the win and loss probabilities,
+        the expected trial length and the expected site occupancy are also
+        computed from the chain, by solving tridiagonal linear systems, and
+        printed after the simulated values. (The exact values ignore the
+        MAX_ITERATIONS limit on a trial, which is practically never reached.)
+
 	For more information on Parrondo games and related phenomena see
         J. Parrondo's website, http://seneca.fis.ucm.es/parr/,  or the
         announcement in Nature magazine, 23/30, December 1999.
 */
 
-/* compile: cc -o parrondo parrondo.c 
+/* compile: cc -o parrondo parrondo.c -lpthread -lm
+
+      Random numbers come from the xoshiro256** generator of D. Blackman
+        and S. Vigna (see https://prng.di.unimi.it/), implemented below,
+        rather than from the library's rand or random. It is much faster,
+        has far better statistical quality than most rand()s, and keeps
+        its state in a struct rather than in hidden global state, which
+        glibc's random() protects with a lock on every call. Its output is
+        therefore the same on every system. A C99 compiler is needed for
+        stdint.h.
 
-      Use -D_NO_RANDOM if your library doesn't have random/srandom. Most do,
-       	but the only truly portable RNG is rand/srand. Unfortunately it has
-        very poor performance, so you should use random if possible.
+      Trials can be run on several threads with -j. Each trial draws
+        from its own stream, seeded from the -s seed and the trial's
+        number (see rng_stream below), and the counts are integers summed
+        after the threads finish, so the output for a given seed is the
+        same whatever the number of threads.
 
-      Use -D_MAX_RAND=  to set the size of the maximum value returned by
-         random(). The portable RNG rand() always returns a maximum of 
-         RAND_MAX (defined in stdlib.h), but some implementations of random
-         do not use this value. Read the man page for random to be sure. A
-	 common value is 2^31-1 = 2147483647. In so, and this is not the
-         value of RAND_MAX on your system, you would compile with
-         -D_MAX_RAND=214748367.
+      With -batch the trials are run LANES at a time in lockstep, each
+        lane with its own generator, and a lane whose trial ends is given
+        the next trial. The inner loop over lanes has no branches, so the
+        compiler can vectorize it; compile with -O3 -march=native (on x86,
+        SSE4.2 or later is needed for 64-bit vector compares). A trial
+        uses the same random numbers either way, so -batch gives exactly
+        the same output; -check runs both and compares them.
 
       Use -D_SHORT_STRINGS if your compiler does not support multiline
           string constants.
@@ -52,17 +86,32 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<string.h>
 #include<math.h>
 #include<time.h>
+#include<stdint.h>
+#include<pthread.h>
 
-#define VERSION "1.1"
-#define USAGE "parrondo [ -s number -t number -m number -1 -2 -h -v]"
+#define VERSION "1.7"
+#define USAGE "parrondo [ -s number -t number -m number -ps p -pb p -pg p -pc p -sweep file -w width -j threads -batch -check -exact -1 -2 -h -v]"
 #ifndef _SHORT_STRINGS
-#define HELP "parrondo [ -s number -t number -m number -1 -2 ]\n\n\
+#define HELP "parrondo [ -s number -t number -m number -ps p -pb p -pg p -pc p -sweep file -w width -j threads -batch -check -exact -1 -2 ]\n\n\
 Print information on simulations of Parrondo's paradoxical game.\n\n\
 -s: Use next argument as RNG seed. (otherwise use system time as seed.)\n\
 -t: Use next argument as number of trials. Default 10000.\n\
 -m: Use number as max fortune (win), -number as min fortune(loss). Default 50. \n\
+-ps, -pb, -pg: Win probability of the simple game's coin, and of the bad\n\
+    and good coins of the complex game. Defaults .495, .095, .745.\n\
+-pc: Probability of choosing the complex game for a play. Default .5.\n\
+-sweep: Simulate a grid of games and write a CSV table to the next argument\n\
+    (- for standard output). Any of -ps, -pb, -pg, -pc may then be a\n\
+    range lo:hi:n of n values.\n\
+-w: Stop once the 95% confidence intervals for P(win) and P(loss) are\n\
+    narrower than the next argument. (In a sweep, each point stops on its own.)\n\
+-j: Run trials on this many threads. Default 1. Results do not depend on it.\n\
+-batch: Run trials in lockstep batches. Same results, faster.\n\
+-check: Run both the plain and the batched simulation and compare them.\n\
+-exact: Also print the exact values from the Markov chain.\n\
 -v: Print version number and exit. \n\
 -h: Print this helpful information. \n\
 -1: Simulate simple game alone.\n\
@@ -72,21 +121,15 @@ Print information on simulations of Parrondo's paradoxical game.\n\n\
 #endif
 
 
-#ifdef _NO_RANDOM
-#define RANDOM rand
-#define SRANDOM srand
-#else
-#define RANDOM random
-#define SRANDOM srandom
-#endif
-
 /* Default values */
 #define MAX_FORTUNE 50
 #define MAX_ITERATIONS 1000000L
 #define TRIALS 10000
 #define INITIAL_SEED 3445
-#ifndef _MAX_RAND
-#define _MAX_RAND RAND_MAX
+#define MAX_THREADS 64
+#define TRIAL_BLOCK 64	/* trials handed to a thread at a time */
+#ifndef LANES
+#define LANES 16	/* trials run in lockstep by -batch */
 #endif
 
 /* See above for meaning of these */
@@ -95,70 +138,866 @@ Print information on simulations of Parrondo's paradoxical game.\n\n\
 #define GOOD_WIN_PROB .745
 
 
+/* The state of an xoshiro256** generator */
+
+struct rng {
+	uint64_t s[4];
+};
+
+static uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Return the next 64 random bits */
+
+uint64_t
+rng_next(struct rng *r)
+{
+	uint64_t *s = r->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+/* Initialize the state from a seed. As its authors recommend, the state
+   is filled from the splitmix64 generator, so that similar seeds give
+   unrelated states and the state is never all zero. */
+
+void
+rng_seed(struct rng *r, uint64_t seed)
+{
+	int i;
+	uint64_t z;
+
+	for(i=0;i<4;i++){
+		z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		r->s[i] = z ^ (z >> 31);
+	}
+}
+
+/* Initialize the stream for trial k. The four words of trial k's state
+   are outputs 4k+1 ... 4k+4 of the splitmix64 sequence started at seed.
+   Splitmix64 is one to one in its counter, so every trial starts from a
+   different state, and a trial's numbers depend only on seed and k, not
+   on which thread runs it or in what order. */
+
+void
+rng_stream(struct rng *r, uint64_t seed, uint64_t k)
+{
+	rng_seed(r, seed + 4*k*0x9e3779b97f4a7c15ULL);
+}
+
+/* Coins are represented by thresholds: a toss is heads when the top 53
+   bits of a random number, as an integer, are below p*2^53. This is the
+   same as comparing a uniform double in [0,1) with p, without converting
+   or dividing. p = 1 gives 2^53, which is always heads. */
+
+#define THRESHOLD(p) ((uint64_t)((p)*9007199254740992.0))
+
+/* A game: the win probabilities of the simple game's coin and of the bad
+   and good coins, the probability of choosing the complex game for a
+   play, and the thresholds of all four. */
+
+struct game {
+	double s_prob, bad_prob, good_prob, select_prob;
+	uint64_t s_win, bad_win, good_win, select;
+};
+
+void
+game_init(struct game *g, double s, double bad, double good, double select)
+{
+	g->s_prob = s;
+	g->bad_prob = bad;
+	g->good_prob = good;
+	g->select_prob = select;
+	g->s_win = THRESHOLD(s);
+	g->bad_win = THRESHOLD(bad);
+	g->good_win = THRESHOLD(good);
+	g->select = THRESHOLD(select);
+}
+
 /* return -1 or +1 according as a simulated coin toss is heads (+1) or
-   tails (-1). Take p as probability of heads.
+   tails (-1). Take t = THRESHOLD(p), where p is the probability of heads.
 */
 
 int
-cointoss(double p)
+cointoss(struct rng *r, uint64_t t)
 {
-
-	double U;   /* U(0,1) random variable */
-
-	U = ((double)RANDOM())/((double)_MAX_RAND);
-	return U >= p ? -1 : 1;
+	return (rng_next(r) >> 11) < t ? 1 : -1;
 } 
 
 /* One play of the simple game: +1 if win, -1 if loss. */
 
-int play_s(void)
+int play_s(struct rng *r, struct game *g)
 {
-	return cointoss(S_WIN_PROB);
+	return cointoss(r,g->s_win);
 		
 }
 
 /* One play of the complicated game: +1 if win, -1 if loss. */
 
-int play_c(int fortune)
+int play_c(struct rng *r, struct game *g, int fortune)
 {
 
 	if( fortune % 3 )
-		return cointoss(GOOD_WIN_PROB);
-	return cointoss(BAD_WIN_PROB);
+		return cointoss(r,g->good_win);
+	return cointoss(r,g->bad_win);
+}
+
+/* Probability that a play of game g from fortune f is won */
+
+double
+win_prob(struct game *g, int f)
+{
+	return (1.0-g->select_prob)*g->s_prob +
+		g->select_prob*(f % 3 ? g->good_prob : g->bad_prob);
+}
+
+/* Solve the tridiagonal system a[i]x[i-1] + b[i]x[i] + c[i]x[i+1] = d[i],
+   i = 0 ... n-1, by the Thomas algorithm (a[0] and c[n-1] are not used).
+   The solution replaces d, and c is overwritten. The systems below are
+   diagonally dominant, so no pivoting is needed. */
+
+void
+tridiag(int n, double *a, double *b, double *c, double *d)
+{
+	int i;
+	double m;
+
+	c[0] /= b[0];
+	d[0] /= b[0];
+	for(i=1;i<n;i++){
+		m = b[i] - a[i]*c[i-1];
+		c[i] /= m;
+		d[i] = (d[i] - a[i]*d[i-1])/m;
+	}
+	for(i=n-2;i>=0;i--)
+		d[i] -= c[i]*d[i+1];
+}
+
+/* Exact statistics of a trial of game g. Unknown i is the value at fortune
+   f = i - max + 1, for the 2max-1 fortunes strictly between the limits.
+   With Q the transition matrix among these fortunes, the probabilities of
+   winning and losing from each fortune, and the expected number of plays,
+   solve (I - Q)x = d, where d holds the chance of reaching the top or
+   bottom limit in one play, or 1 for the length. The expected number of
+   visits to each fortune starting from 0 is the row of (I - Q)^-1 for
+   fortune 0, which solves the transposed system. The simulation counts
+   visits after each play, so the start is not counted. Returns -1 if max
+   is less than 1 or memory runs out. */
+
+int
+exact(struct game *g, int max, double *win, double *loss, double *len,
+	double occ[3])
+{
+	int i, n = 2*max-1, z = max-1;
+	double *p, *a, *b, *c, *d;
+
+	if(n < 1 || (p = malloc(5*n*sizeof(double))) == NULL)
+		return -1;
+	a = p+n; b = a+n; c = b+n; d = c+n;
+	for(i=0;i<n;i++)
+		p[i] = win_prob(g, i-z);
+
+	/* P(win), P(loss), E(plays) from fortune 0 */
+#define SETUP for(i=0;i<n;i++){ a[i] = p[i]-1.0; b[i] = 1.0; c[i] = -p[i]; d[i] = 0.0; }
+	SETUP
+	d[n-1] = p[n-1];
+	tridiag(n,a,b,c,d);
+	*win = d[z];
+	SETUP
+	d[0] = 1.0-p[0];
+	tridiag(n,a,b,c,d);
+	*loss = d[z];
+	SETUP
+	for(i=0;i<n;i++)
+		d[i] = 1.0;
+	tridiag(n,a,b,c,d);
+	*len = d[z];
+#undef SETUP
+
+	/* Expected visits: x[j] - p[j-1]x[j-1] - (1-p[j+1])x[j+1] = [j == z] */
+	for(i=0;i<n;i++){
+		a[i] = i > 0 ? -p[i-1] : 0.0;
+		b[i] = 1.0;
+		c[i] = i < n-1 ? p[i+1]-1.0 : 0.0;
+		d[i] = 0.0;
+	}
+	d[z] = 1.0;
+	tridiag(n,a,b,c,d);
+	d[z] -= 1.0;
+	occ[0] = occ[1] = occ[2] = 0.0;
+	for(i=0;i<n;i++)
+		occ[abs(i-z)%3] += d[i];
+	for(i=0;i<3;i++)
+		occ[i] /= *len;
+	free(p);
+	return 0;
+}
+
+/* Counts accumulated over trials. They are all integers, so tallies
+   from different threads add up to exactly the serial result. The sums
+   of squares are kept only for a block of trials; they would overflow
+   over a long run. */
+
+struct tally {
+	long trials, wins, losses;
+	long long plays;
+	long long site_visits[3];  /* counts visits to numbers mod 3 */
+	long long plays2, fortunes, fortunes2;	/* sums of n^2, f and f^2 */
+};
+
+void
+tally_add(struct tally *a, struct tally *b)
+{
+	a->trials += b->trials;
+	a->wins += b->wins;
+	a->losses += b->losses;
+	a->plays += b->plays;
+	a->site_visits[0] += b->site_visits[0];
+	a->site_visits[1] += b->site_visits[1];
+	a->site_visits[2] += b->site_visits[2];
+	a->plays2 += b->plays2;
+	a->fortunes += b->fortunes;
+	a->fortunes2 += b->fortunes2;
+}
+
+/* Running mean and sum of squared deviations (Welford), merged a block
+   of n values with mean mean and squared deviations m2 at a time by the
+   pairwise form of the update (Chan et al.). */
+
+struct moments {
+	long n;
+	double mean, m2;
+};
+
+void
+moments_add(struct moments *a, long n, double mean, double m2)
+{
+	double delta = mean - a->mean;
+	long t = a->n + n;
+
+	if(n == 0)
+		return;
+	a->mean += delta*n/t;
+	a->m2 += m2 + delta*delta*((double)a->n*n/t);
+	a->n = t;
+}
+
+/* Add the n values whose sum and sum of squares are s and s2 */
+
+void
+moments_sums(struct moments *a, long n, long long s, long long s2)
+{
+	if(n > 0)
+		moments_add(a, n, (double)s/n, (double)(n*s2 - s*s)/n);
+}
+
+double
+moments_sd(struct moments *a)
+{
+	return a->n > 1 ? sqrt(a->m2/(a->n-1)) : 0.0;
+}
+
+/* The 95% confidence interval [*lo, *hi] for a probability, from k
+   successes in n trials (Wilson's score interval, which unlike the usual
+   p +- 1.96 sd stays sensible when k is 0 or n). */
+
+#define Z95 1.959963984540054
+
+void
+wilson(long k, long n, double *lo, double *hi)
+{
+	double p, c, h, z2 = Z95*Z95;
+
+	if(n < 1){
+		*lo = 0.0;
+		*hi = 1.0;
+		return;
+	}
+	p = (double)k/n;
+	c = (p + z2/(2*n))/(1 + z2/n);
+	h = Z95/(1 + z2/n)*sqrt(p*(1-p)/n + z2/(4.0*n*n));
+	*lo = c - h > 0.0 ? c - h : 0.0;
+	*hi = c + h < 1.0 ? c + h : 1.0;
+
+	/* c - h is exactly 0 for k = 0, and c + h exactly 1 for k = n, but
+	   not after rounding */
+
+	if(k == 0)*lo = 0.0;
+	if(k == n)*hi = 1.0;
+}
+
+/* Trials are handed out TRIAL_BLOCK at a time. A block's tally is kept
+   in the ring until all its trials are done, and then merged into the
+   totals, in order of block number, so that the totals and the moments
+   are the same whatever the number of threads. The ring grows when
+   blocks finish too far ahead of the oldest unfinished one. */
+
+struct block {
+	struct tally t;
+	long left;	/* trials not yet done */
+};
+
+/* What the threads share: the parameters of the run, the next trial not
+   yet handed out, and the totals of the blocks merged so far. */
+
+struct run {
+	uint64_t seed;
+	struct game g;
+	int max_fortune;
+	long trials, next;
+	int batch;	/* use batch() rather than trial() */
+	double width;	/* stop when the intervals are narrower, if > 0 */
+
+	struct block *ring;
+	long nring, merged;	/* ring size; blocks merged */
+	int stop;	/* width was reached: hand out no more trials */
+	struct tally total;
+	struct moments length, fortune;	/* of the trial lengths and
+					   final fortunes */
+	pthread_mutex_t lock;
+};
+
+/* Make run ready to be simulated. Returns -1 if out of memory. */
+
+int
+run_start(struct run *run)
+{
+	run->nring = 16;
+	if((run->ring = malloc(run->nring*sizeof(*run->ring))) == NULL)
+		return -1;
+	run->next = run->merged = 0L;
+	run->stop = 0;
+	memset(&run->total,0,sizeof(run->total));
+	memset(&run->length,0,sizeof(run->length));
+	memset(&run->fortune,0,sizeof(run->fortune));
+	pthread_mutex_init(&run->lock,NULL);
+	return 0;
+}
+
+void
+run_end(struct run *run)
+{
+	pthread_mutex_destroy(&run->lock);
+	free(run->ring);
+}
+
+/* Do the 95% intervals for the win and loss rates have width < w? */
+
+int
+narrow(struct tally *t, double w)
+{
+	double lo, hi;
+
+	wilson(t->wins, t->trials, &lo, &hi);
+	if(hi - lo >= w)
+		return 0;
+	wilson(t->losses, t->trials, &lo, &hi);
+	return hi - lo < w;
+}
+
+/* Has the run stopped early? */
+
+int
+stopped(struct run *run)
+{
+	int s;
+
+	pthread_mutex_lock(&run->lock);
+	s = run->stop;
+	pthread_mutex_unlock(&run->lock);
+	return s;
+}
+
+/* Number of the next trial to run, taken from the block [*k, *end); when
+   the block is used up, a new one is taken from run. Returns -1 when
+   there are no trials left, or the run has stopped. */
+
+long
+next_trial(struct run *run, long *k, long *end)
+{
+	struct block *ring;
+	long b, i;
+
+	if(*k >= *end){
+		pthread_mutex_lock(&run->lock);
+		*k = run->next;
+		*end = run->next = *k+TRIAL_BLOCK < run->trials ?
+			*k+TRIAL_BLOCK : run->trials;
+		if(run->stop)
+			*k = *end = run->next = run->trials;
+		b = *k/TRIAL_BLOCK;
+		if(*k < *end && b - run->merged >= run->nring){
+			/* double the ring, keeping blocks in their slots */
+			if((ring = malloc(2*run->nring*sizeof(*ring))) == NULL){
+				fprintf(stderr,"parrondo: out of memory\n");
+				exit(1);
+			}
+			for(i=run->merged;i<b;i++)
+				ring[i % (2*run->nring)] =
+					run->ring[i % run->nring];
+			free(run->ring);
+			run->ring = ring;
+			run->nring *= 2;
+		}
+		if(*k < *end){
+			memset(&run->ring[b % run->nring],0,sizeof(struct block));
+			run->ring[b % run->nring].left = *end - *k;
+		}
+		pthread_mutex_unlock(&run->lock);
+		if(*k >= *end)
+			return -1;
+	}
+	return (*k)++;
+}
+
+/* Count trial k, whose outcome is t. When that finishes its block, merge
+   the finished blocks at the front into the totals; with a width, stop
+   once the intervals are narrow enough. */
+
+void
+trial_done(struct run *run, long k, struct tally *t)
+{
+	struct block *p;
+
+	pthread_mutex_lock(&run->lock);
+	p = &run->ring[(k/TRIAL_BLOCK) % run->nring];
+	tally_add(&p->t,t);
+	if(--p->left == 0)
+		while(!run->stop && run->merged*TRIAL_BLOCK < run->next &&
+		      (p = &run->ring[run->merged % run->nring])->left == 0){
+			moments_sums(&run->length,p->t.trials,
+				p->t.plays,p->t.plays2);
+			moments_sums(&run->fortune,p->t.trials,
+				p->t.fortunes,p->t.fortunes2);
+			p->t.plays2 = p->t.fortunes = p->t.fortunes2 = 0;
+			tally_add(&run->total,&p->t);
+			run->merged++;
+			if(run->width > 0.0 && narrow(&run->total,run->width))
+				run->stop = 1;
+		}
+	pthread_mutex_unlock(&run->lock);
+}
+
+/* The tally of a single trial that ended at fortune after n plays */
+
+void
+trial_tally(struct tally *t, int max_fortune, long n, long fortune)
+{
+	t->trials = 1;
+	t->wins = fortune == max_fortune;
+	t->losses = fortune == -max_fortune;
+	t->plays = n;
+	t->plays2 = (long long)n*n;
+	t->fortunes = fortune;
+	t->fortunes2 = (long long)fortune*fortune;
+}
+
+/* Simulate trial k */
+
+void
+trial(struct run *run, long k)
+{
+	struct rng r;
+	struct tally t;
+	long n = 0L;
+	int fortune = 0, m;
+	int max_fortune = run->max_fortune;
+
+	memset(&t,0,sizeof(t));
+	rng_stream(&r, run->seed, (uint64_t)k);
+	/* Loop until fortune goes out of range */
+	while(n++<MAX_ITERATIONS){
+		if(cointoss(&r,run->g.select) == 1)
+			fortune += play_c(&r,&run->g,fortune);
+		else
+			fortune += play_s(&r,&run->g);
+		if((fortune >= max_fortune)||(fortune <= -max_fortune))
+			break;
+
+		m = fortune > 0 ? fortune : -fortune;
+		t.site_visits[m%3]++;
+	}
+	trial_tally(&t, max_fortune, n, fortune);
+	trial_done(run, k, &t);
+}
+
+/* Trials run in lockstep, one per lane. The generator states are stored
+   by word, so that each step of the inner loop works on the same word of
+   every lane. The fortune mod 3 is kept alongside the fortune, as
+   residue in 0 ... 2, because a 64-bit % does not vectorize. A lane
+   whose trial has ended and cannot be refilled is
+   dead (live = 0): it keeps stepping, but nothing it does is counted. */
+
+struct lanes {
+	uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+	int64_t fortune[LANES], residue[LANES], n[LANES], live[LANES];
+	int64_t visits0[LANES], visits1[LANES], visits2[LANES];
+	long k[LANES];	/* trial number */
+};
+
+/* Start trial k in lane l, or kill the lane if k < 0. */
+
+void
+lane_start(struct lanes *b, int l, struct run *run, long k)
+{
+	struct rng r;
+
+	rng_stream(&r, run->seed, (uint64_t)(k < 0 ? 0 : k));
+	b->s0[l] = r.s[0];
+	b->s1[l] = r.s[1];
+	b->s2[l] = r.s[2];
+	b->s3[l] = r.s[3];
+	b->fortune[l] = 0;
+	b->residue[l] = 0;
+	b->n[l] = 0;
+	b->visits0[l] = b->visits1[l] = b->visits2[l] = 0;
+	b->live[l] = k >= 0;
+	b->k[l] = k;
+}
+
+/* One xoshiro256** step on the state s0 ... s3, leaving the output in x;
+   the same as rng_next. */
+
+#define LANE_NEXT(x) do { \
+	uint64_t t_ = s1 << 17; \
+	x = rotl(s1 * 5, 7) * 9; \
+	s2 ^= s0; \
+	s3 ^= s1; \
+	s1 ^= s2; \
+	s0 ^= s3; \
+	s2 ^= t_; \
+	s3 = rotl(s3, 45); \
+	} while(0)
+
+/* Run trials taken by next_trial from [*k, *end) and run, LANES at a
+   time. Each play draws two numbers, the game and the coin, as in
+   trial(), so each trial has the same outcome as trial() would give.
+   Once the run stops, the trials still running are dropped; they are
+   all in blocks that will not be counted. */
+
+void
+batch(struct run *run, long *k, long *end)
+{
+	struct lanes b;
+	struct tally t;
+	int l, nlive = 0;
+	int64_t max = run->max_fortune, any, f, r, d, m, live, out;
+	uint64_t s0, s1, s2, s3, x, y, c, select = run->g.select;
+	uint64_t sw = run->g.s_win, bw = run->g.bad_win, gw = run->g.good_win;
+
+	for(l=0;l<LANES;l++){
+		lane_start(&b, l, run, next_trial(run, k, end));
+		nlive += b.live[l];
+	}
+	while(nlive){
+		/* One play in every lane */
+		any = 0;
+		for(l=0;l<LANES;l++){
+			s0 = b.s0[l]; s1 = b.s1[l]; s2 = b.s2[l]; s3 = b.s3[l];
+			LANE_NEXT(x);
+			LANE_NEXT(y);
+			b.s0[l] = s0; b.s1[l] = s1; b.s2[l] = s2; b.s3[l] = s3;
+			f = b.fortune[l];
+			r = b.residue[l];
+			live = b.live[l];
+			c = r ? gw : bw;
+			c = (x >> 11) < select ? c : sw;
+			d = ((y >> 11) < c ? 1 : -1) & -live;
+			f += d;
+			r += d;
+			r += (r < 0 ? 3 : 0) - (r == 3 ? 3 : 0);
+			b.fortune[l] = f;
+			b.residue[l] = r;
+			b.n[l] += live;
+			out = (f >= max) | (f <= -max);
+			m = (f < 0) & (r != 0) ? 3 - r : r;	/* |f| mod 3 */
+			b.visits0[l] += live & !out & (m == 0);
+			b.visits1[l] += live & !out & (m == 1);
+			b.visits2[l] += live & !out & (m == 2);
+			any |= live & (out | (b.n[l] >= MAX_ITERATIONS));
+		}
+		if(!any)
+			continue;
+
+		/* Count the trials that ended, and refill their lanes */
+		for(l=0;l<LANES;l++){
+			if(!b.live[l])
+				continue;
+			out = (b.fortune[l] >= max) | (b.fortune[l] <= -max);
+			if(!out && b.n[l] < MAX_ITERATIONS)
+				continue;
+			t.site_visits[0] = b.visits0[l];
+			t.site_visits[1] = b.visits1[l];
+			t.site_visits[2] = b.visits2[l];
+			/* trial() counts one more for a trial that runs out */
+			trial_tally(&t, max, b.n[l] + !out, b.fortune[l]);
+			trial_done(run, b.k[l], &t);
+			lane_start(&b, l, run, next_trial(run, k, end));
+			nlive -= !b.live[l];
+			if(!b.live[l] && stopped(run))
+				return;
+		}
+	}
+}
+
+/* Thread body: run trials until none are left. */
+
+void *
+work(void *arg)
+{
+	struct run *run = arg;
+	long k = 0, end = 0, i;
+
+	if(run->batch)
+		batch(run,&k,&end);
+	else
+		while((i = next_trial(run,&k,&end)) >= 0)
+			trial(run,i);
+	return NULL;
 }
-	
 
+/* Run all the trials of run on nthreads threads, leaving the totals in
+   run. */
+
+void
+simulate(struct run *run, int nthreads)
+{
+	pthread_t id[MAX_THREADS];
+	int j;
+
+	if(run_start(run)){
+		fprintf(stderr,"parrondo: out of memory\n");
+		exit(1);
+	}
+
+	/* Loop over trials: thread 0 is this one, the rest are created. */
+	for(j=1;j<nthreads;j++)
+		if(pthread_create(&id[j],NULL,work,run)){
+			fprintf(stderr,"parrondo: cannot create thread\n");
+			exit(1);
+		}
+	work(run);
+	for(j=1;j<nthreads;j++)
+		pthread_join(id[j],NULL);
+	run_end(run);
+}
+
+/* A range of n evenly spaced values from lo to hi, for -sweep */
+
+struct range {
+	double lo, hi;
+	int n;
+};
+
+/* Read a range from s: either a single value, or lo:hi:n. All values
+   must be probabilities. Returns -1 if s is not a range. */
+
+int
+range_parse(char *s, struct range *r)
+{
+	char *e;
+
+	r->lo = r->hi = strtod(s,&e);
+	r->n = 1;
+	if(*e == ':'){
+		r->hi = strtod(e+1,&e);
+		if(*e++ != ':')
+			return -1;
+		r->n = (int)strtol(e,&e,10);
+		if(r->n < 1)
+			return -1;
+	}
+	if(*e || e == s || !(r->lo >= 0.0 && r->lo <= 1.0) ||
+	   !(r->hi >= 0.0 && r->hi <= 1.0))
+		return -1;
+	return 0;
+}
+
+/* Value i of range r */
+
+double
+range_at(struct range *r, int i)
+{
+	if(r->n == 1)
+		return r->lo;
+	return r->lo + (r->hi - r->lo)*i/(r->n - 1);
+}
+
+/* A sweep: a run for each point of the grid, and the next point to be
+   run. */
+
+struct sweep {
+	struct run *runs;
+	int npoints, next;
+	pthread_mutex_t lock;
+};
+
+/* Thread body for a sweep: run whole points, one at a time, until none
+   are left. */
+
+void *
+sweep_work(void *arg)
+{
+	struct sweep *s = arg;
+	int i;
+
+	for(;;){
+		pthread_mutex_lock(&s->lock);
+		i = s->next++;
+		pthread_mutex_unlock(&s->lock);
+		if(i >= s->npoints)
+			break;
+		if(run_start(&s->runs[i])){
+			fprintf(stderr,"parrondo: out of memory\n");
+			exit(1);
+		}
+		work(&s->runs[i]);
+		run_end(&s->runs[i]);
+	}
+	return NULL;
+}
+
+/* Simulate every point of the grid of games given by ranges
+   r[0] ... r[3] (simple, bad and good coins, complex game) on nthreads
+   threads, each run as described by proto, and write the CSV table to
+   out. With exact_stats, the exact win and loss probabilities and trial
+   length are added to each line. With a width in proto, each point
+   stops on its own. */
+
+void
+sweep(struct range r[4], struct run *proto, int nthreads, int exact_stats,
+	FILE *out)
+{
+	struct sweep s;
+	pthread_t id[MAX_THREADS];
+	int i, j, k, q[4];
+	long n;
+	double e_win, e_loss, e_len, e_occ[3];
+	double win_lo, win_hi, loss_lo, loss_hi;
+	struct game *g;
+	struct tally *t;
+
+	s.npoints = r[0].n*r[1].n*r[2].n*r[3].n;
+	s.next = 0;
+	if((s.runs = malloc(s.npoints*sizeof(*s.runs))) == NULL){
+		fprintf(stderr,"parrondo: out of memory\n");
+		exit(1);
+	}
+	pthread_mutex_init(&s.lock,NULL);
+	for(i=0;i<s.npoints;i++){
+		/* point i in the order select, simple, bad, good */
+		k = i;
+		for(j=2;j>=0;j--){
+			q[j] = k % r[j].n;
+			k /= r[j].n;
+		}
+		q[3] = k;
+		s.runs[i] = *proto;
+		game_init(&s.runs[i].g, range_at(&r[0],q[0]), range_at(&r[1],q[1]),
+			range_at(&r[2],q[2]), range_at(&r[3],q[3]));
+	}
+
+	if(nthreads > s.npoints)
+		nthreads = s.npoints;
+	for(j=1;j<nthreads;j++)
+		if(pthread_create(&id[j],NULL,sweep_work,&s)){
+			fprintf(stderr,"parrondo: cannot create thread\n");
+			exit(1);
+		}
+	sweep_work(&s);
+	for(j=1;j<nthreads;j++)
+		pthread_join(id[j],NULL);
+
+	fprintf(out,"complex,simple,bad,good,max_fortune,trials,"
+		"wins,losses,draws,win_rate,loss_rate,mean_length,"
+		"win_lo,win_hi,loss_lo,loss_hi,length_sd,mean_fortune,"
+		"fortune_sd%s\n",
+		exact_stats ? ",exact_win,exact_loss,exact_length" : "");
+	for(i=0;i<s.npoints;i++){
+		g = &s.runs[i].g;
+		t = &s.runs[i].total;
+		n = t->trials;
+		wilson(t->wins,n,&win_lo,&win_hi);
+		wilson(t->losses,n,&loss_lo,&loss_hi);
+		fprintf(out,"%g,%g,%g,%g,%d,%ld,%ld,%ld,%ld,%.10g,%.10g,%.10g,"
+			"%.6g,%.6g,%.6g,%.6g,%.10g,%.10g,%.10g",
+			g->select_prob, g->s_prob, g->bad_prob, g->good_prob,
+			proto->max_fortune, n, t->wins, t->losses,
+			n - t->wins - t->losses,
+			(double)t->wins/n, (double)t->losses/n,
+			s.runs[i].length.mean,
+			win_lo, win_hi, loss_lo, loss_hi,
+			moments_sd(&s.runs[i].length), s.runs[i].fortune.mean,
+			moments_sd(&s.runs[i].fortune));
+		if(exact_stats){
+			if(exact(g,proto->max_fortune,
+					&e_win,&e_loss,&e_len,e_occ)){
+				fprintf(stderr,"parrondo: out of memory\n");
+				exit(1);
+			}
+			fprintf(out,",%.10g,%.10g,%.10g",e_win,e_loss,e_len);
+		}
+		fprintf(out,"\n");
+	}
+	pthread_mutex_destroy(&s.lock);
+	free(s.runs);
+}
 
 int
 main(int argc, char **argv)
 {
-	long n=0L;
-	double n_bar,n_tot=0.0;
+	double n_bar,n_tot;
 	int trials = TRIALS;
-	int i=0,j=0,m;
-	int win_count = 0;
-	int loss_count = 0;
-	long site_visits[3];  /* counts visits to numbers mod 3 */
+	int i=0,j=0;
+	int nthreads = 1;
+	int exact_stats = 0;
+	double e_win, e_loss, e_len, e_occ[3];
+	double lo, hi, width = 0.0;
 	int max_fortune = MAX_FORTUNE;
-	double game_select = 0.5;  /* Governs a coin toss below which selects
-                                      between games. Setting this to 1.0 chooses
-				      complex game only. Setting to 0.0 chooses
-                                      simple game only. 
-				   */
-                                      
+	struct range r[4] = {	/* simple, bad and good coins; complex game */
+		{ S_WIN_PROB, S_WIN_PROB, 1 },
+		{ BAD_WIN_PROB, BAD_WIN_PROB, 1 },
+		{ GOOD_WIN_PROB, GOOD_WIN_PROB, 1 },
+		{ 0.5, 0.5, 1 }	/* Governs a coin toss below which selects
+				   between games. Setting this to 1.0 chooses
+				   complex game only. Setting to 0.0 chooses
+				   simple game only. */
+	};
+	struct range *p;
+	char *sweep_file = NULL;
+	FILE *out;
+
+	struct run run;
+	struct tally total, check;
+	int batched = 0, cross_check = 0;
 	long seed=0;
 
 	/* Process command line */
 	while(++j < argc){
 		if(argv[j][0] == '-')
-			switch(argv[j][1]){ 
+			switch(argv[j][1]){
 				case 's':
 				case 'S':
 					if(j+1 >= argc){
 						fprintf(stderr,"%s\n",USAGE);
 						exit(1);
 					}
-					seed = atol(argv[j+1]);
+					if(!strcmp(argv[j]+1,"sweep"))
+						sweep_file = argv[j+1];
+					else
+						seed = atol(argv[j+1]);
 					j++;
 					continue;
 				case 't':
@@ -169,7 +1008,7 @@ main(int argc, char **argv)
 					}
 					trials = atoi(argv[j+1]);
 					j++;
-					continue;	
+					continue;
 				case 'm':
 				case 'M':
 					if(j+1 >= argc){
@@ -179,6 +1018,60 @@ main(int argc, char **argv)
 					max_fortune = atoi(argv[j+1]);
 					j++;
 					continue;
+				case 'p':
+				case 'P':
+					switch(argv[j][2]){
+						case 's': p = &r[0]; break;
+						case 'b': p = &r[1]; break;
+						case 'g': p = &r[2]; break;
+						case 'c': p = &r[3]; break;
+						default: p = NULL;
+					}
+					if(p == NULL || argv[j][3] || j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					if(range_parse(argv[j+1],p)){
+						fprintf(stderr,"parrondo: bad probability "
+							"or range %s\n",argv[j+1]);
+						exit(1);
+					}
+					j++;
+					continue;
+				case 'j':
+				case 'J':
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					nthreads = atoi(argv[j+1]);
+					if(nthreads < 1)
+						nthreads = 1;
+					if(nthreads > MAX_THREADS)
+						nthreads = MAX_THREADS;
+					j++;
+					continue;
+				case 'w':
+				case 'W':
+					if(j+1 >= argc){
+						fprintf(stderr,"%s\n",USAGE);
+						exit(1);
+					}
+					width = atof(argv[j+1]);
+					j++;
+					continue;
+				case 'b':
+				case 'B':
+					batched = 1;
+					continue;
+				case 'c':
+				case 'C':
+					cross_check = 1;
+					continue;
+				case 'e':
+				case 'E':
+					exact_stats = 1;
+					continue;
 				case 'v':
 				case 'V':
 					printf("%s\n",VERSION);
@@ -189,10 +1082,12 @@ main(int argc, char **argv)
 					printf("%s\n",HELP);
 					exit(0);
 				case '1':
-					game_select = 0.0;
+					r[3].lo = r[3].hi = 0.0;
+					r[3].n = 1;
 					break;
 				case '2':
-					game_select = 1.0;
+					r[3].lo = r[3].hi = 1.0;
+					r[3].n = 1;
 					break;
 				default:
 					fprintf(stderr,"parrondo: unkown option %s\n",
@@ -204,66 +1099,115 @@ main(int argc, char **argv)
 			exit(1);
 		}
 	}
- 
+
 	/* If no seed is supplied, then use current system time */
-	
+
 	if(!seed)
 		if((seed = (long)time(NULL)) == -1){
 			seed = INITIAL_SEED; /* if all else fails */
 			fprintf(stderr, "Using seed = %d\n",INITIAL_SEED);
 		}
-		
-	SRANDOM((int)seed);
-	for(i=0;i<3;i++)site_visits[i] = 0L;  /* initialize counters */
-	i=0;
-	printf("Simulating %d trials ...\n",trials);
-	while(i<trials){   /* Loop over trials */
-	int fortune = 0;
-		/* reseed */
-		seed = RANDOM();
-		SRANDOM((int)seed);
-
-		/* Each trial: loop until fortune goes out of range */
-		fortune = 0;
-		while(n++<MAX_ITERATIONS){
-			if(cointoss(game_select) == 1)
-				fortune += play_c(fortune);
-			else
-				fortune += play_s();
-			if((fortune >= max_fortune)||(fortune <= -max_fortune))
-				break;
-
-			m = fortune > 0 ? fortune : -fortune;
-			site_visits[m%3]++;	
-		}
 
-		if(fortune == max_fortune)
-			win_count++;
-		else if(fortune == -max_fortune)
-			loss_count++;
+	if(exact_stats && max_fortune < 1){
+		fprintf(stderr,"parrondo: -exact needs a max fortune of at least 1\n");
+		exit(1);
+	}
+	run.seed = (uint64_t)seed;
+	run.max_fortune = max_fortune;
+	run.trials = trials > 0 ? trials : 0;
+	run.batch = batched;
+	run.width = width;
 
-		i++;
-		n_tot += (double)n;
-		n = 0L;
-		
+	if(sweep_file != NULL){
+		if(run.trials < 1){
+			fprintf(stderr,"parrondo: -sweep needs at least 1 trial\n");
+			exit(1);
+		}
+		if(!strcmp(sweep_file,"-"))
+			out = stdout;
+		else if((out = fopen(sweep_file,"w")) == NULL){
+			fprintf(stderr,"parrondo: cannot open %s\n",sweep_file);
+			exit(1);
+		}
+		sweep(r,&run,nthreads,exact_stats,out);
+		if(out != stdout && fclose(out)){
+			fprintf(stderr,"parrondo: error writing %s\n",sweep_file);
+			exit(1);
+		}
+		return 0;
 	}
+	for(i=0;i<4;i++)
+		if(r[i].n > 1){
+			fprintf(stderr,"parrondo: ranges need -sweep\n");
+			exit(1);
+		}
 
+	game_init(&run.g,r[0].lo,r[1].lo,r[2].lo,r[3].lo);
+	printf("Simulating %d trials ...\n",trials);
+	fflush(stdout);
+	simulate(&run,nthreads);
+	total = run.total;
+	if(cross_check){
+		run.batch = !batched;
+		simulate(&run,nthreads);
+		check = run.total;
+		if(check.trials != total.trials ||
+		   check.wins != total.wins || check.losses != total.losses ||
+		   check.plays != total.plays ||
+		   check.site_visits[0] != total.site_visits[0] ||
+		   check.site_visits[1] != total.site_visits[1] ||
+		   check.site_visits[2] != total.site_visits[2]){
+			fprintf(stderr,"parrondo: batched and plain "
+				"simulations differ\n");
+			exit(1);
+		}
+		printf("Batched and plain simulations agree.\n");
+	}
+	i = total.trials;
+	n_tot = (double)total.plays;
 	n_bar = n_tot/((double)i);
 
+	if(exact_stats && exact(&run.g,max_fortune,
+			&e_win,&e_loss,&e_len,e_occ)){
+		fprintf(stderr,"parrondo: out of memory\n");
+		exit(1);
+	}
+
 	/* Print stuff out */
 
-	printf("%d wins, %d losses, %d draws\n",win_count,
-			loss_count, i-(win_count+loss_count));
+	if(i < run.trials)
+		printf("Stopped after %d trials, with both intervals "
+			"narrower than %g.\n",i,width);
+	printf("%ld wins, %ld losses, %ld draws\n",total.wins,
+			total.losses, i-(total.wins+total.losses));
+	if(exact_stats)
+		printf("Exact: %g wins, %g losses per %d trials "
+			"(P(win) = %.10g, P(loss) = %.10g)\n",
+			e_win*i, e_loss*i, i, e_win, e_loss);
+	wilson(total.wins,i,&lo,&hi);
+	printf("95%% confidence intervals: P(win) %.6g ... %.6g, ",lo,hi);
+	wilson(total.losses,i,&lo,&hi);
+	printf("P(loss) %.6g ... %.6g\n",lo,hi);
 	printf("(Win/loss = %d/-%d, draw = no win/loss in %ld plays.)\n",
 			max_fortune,max_fortune,MAX_ITERATIONS);
 	printf("Average trial length = %g\n",n_bar);
+	if(exact_stats)
+		printf("Exact average trial length = %.10g\n",e_len);
+	printf("Trial length standard deviation = %g, 95%% confidence "
+		"interval for the average %g ... %g\n",
+		moments_sd(&run.length),
+		run.length.mean - Z95*moments_sd(&run.length)/sqrt(i),
+		run.length.mean + Z95*moments_sd(&run.length)/sqrt(i));
+	printf("Final fortune: average %g, standard deviation %g\n",
+		run.fortune.mean, moments_sd(&run.fortune));
 	printf("Site occupancy: 0 mod 3: %g%%, 1 mod 3: %g%%, 2 mod 3: %g%%\n",
-		100.0*((double)site_visits[0])/n_tot,
-		100.0*((double)site_visits[1])/n_tot,
-		100.0*((double)site_visits[2])/n_tot
+		100.0*((double)total.site_visits[0])/n_tot,
+		100.0*((double)total.site_visits[1])/n_tot,
+		100.0*((double)total.site_visits[2])/n_tot
 	);
+	if(exact_stats)
+		printf("Exact site occupancy: 0 mod 3: %g%%, 1 mod 3: %g%%, "
+			"2 mod 3: %g%%\n",
+			100.0*e_occ[0], 100.0*e_occ[1], 100.0*e_occ[2]);
 	return 0;
 }
-	
-
-